@@ -26,14 +26,18 @@
 App* create_App(void)
 {
 	App *result = NULL;
-	result = g_new(App,1);
+	result = g_new0(App,1);
 	return result;
 }
 
 /* Destructor */
 void free_App(App *what)
 {
-	//TODO add code here for members of the struct
+	g_free(what->description);
+	g_strfreev(what->keyword);
+	g_free(what->command);
+	g_strfreev(what->triggers);
+	g_strfreev(what->extensions);
 	g_free(what);
 }
 
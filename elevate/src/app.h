@@ -30,6 +30,7 @@ typedef struct Application
 	gchar *description;
 	gchar **keyword;
 	gchar *command;
+	gboolean available; /* The command is installed */
 
 	gchar **triggers;
 	gchar **extensions;
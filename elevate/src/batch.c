@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Batch mode feeds sentences from a file or stdin to the same
+ * parser and dispatcher as the window. Every sentence prints one
+ * tab separated line on stdout:
+ *
+ *   sentence  type  confidence  target  parse-ms  run-ms
+ *
+ * Job control and questions have the type "jobs" or "question".
+ * The messages and a summary with the load time and the
+ * throughput go to stderr. Jobs are not saved, so the jobs of the
+ * window are left alone. With --dry-run
+ * commands are only described, which makes module sets easy to
+ * test and the parser easy to benchmark.
+ */
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "messages.h"
+#include "engine.h"
+#include "files.h"
+#include "jobs.h"
+#include "score.h"
+#include "lang.h"
+#include "parser.h"
+#include "batch.h"
+
+/* How often we check if the last jobs have finished */
+#define BATCH_POLL 100
+
+static gchar *describe_target(Sentence *sen);
+static gboolean wait_jobs(gpointer data);
+
+static GMainLoop *loop = NULL;
+
+int run_batch(const gchar *file,gboolean dry_run)
+{
+	GIOChannel *channel = NULL;
+	GError *error = NULL;
+	GTimer *timer = NULL;
+	Engine *eng = NULL;
+	MessageLog *messages = NULL;
+	Scheduler *sched = NULL;
+	gchar *line = NULL;
+	gdouble load = 0;
+	gdouble parsing = 0;
+	gdouble running = 0;
+	guint count = 0;
+	guint understood = 0;
+
+	if(g_strcmp0(file,"-") == 0)
+		channel = g_io_channel_unix_new(0);
+	else
+		channel = g_io_channel_new_file(file,"r",&error);
+	if(channel == NULL)
+	{
+		g_printerr("Could not open %s: %s\n",file,error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	timer = g_timer_new();
+	eng = create_capabilities();
+	load = g_timer_elapsed(timer,NULL);
+
+	messages = create_MessageLog();
+	messages->echo = TRUE;
+	parser_set_dry_run(dry_run);
+	if(!dry_run) sched = create_Scheduler_at(messages,NULL);
+
+	while(g_io_channel_read_line(channel,&line,NULL,NULL,&error) == G_IO_STATUS_NORMAL)
+	{
+		Language *lang = NULL;
+		gchar *target = NULL;
+		InputKind kind;
+		gint type;
+		gdouble parse_time = 0;
+		gdouble run_time = 0;
+
+		g_strstrip(line);
+		if(line[0] == '\0' || line[0] == '#')
+		{
+			g_free(line);
+			continue;
+		}
+
+		g_timer_start(timer);
+		kind = dispatch_input(line,eng,sched,messages);
+		if(kind != INPUT_SENTENCE)
+		{
+			run_time = g_timer_elapsed(timer,NULL);
+			printf("%s\t%s\t%.2f\t-\t%.3f\t%.3f\n",line,
+					kind == INPUT_JOBS ? "jobs" : "question",1.0,
+					parse_time * 1000,run_time * 1000);
+			count++;
+			understood++;
+			running += run_time;
+			g_free(line);
+			continue;
+		}
+
+		g_timer_start(timer);
+		lang = parse_sentence(line,eng);
+		parse_time = g_timer_elapsed(timer,NULL);
+
+		g_timer_start(timer);
+		run_sentence(lang,line,sched,messages);
+		run_time = g_timer_elapsed(timer,NULL);
+
+		type = lang->sen->type;
+		target = describe_target(lang->sen);
+		printf("%s\t%s\t%.2f\t%s\t%.3f\t%.3f\n",line,
+				sentence_type_name(type),lang->sen->confidence,
+				target,parse_time * 1000,run_time * 1000);
+		g_free(target);
+
+		count++;
+		if(type >= 0) understood++;
+		parsing += parse_time;
+		running += run_time;
+
+		free_Language(lang);
+		g_free(line);
+	}
+	if(error != NULL)
+	{
+		g_printerr("Could not read %s: %s\n",file,error->message);
+		g_error_free(error);
+	}
+	g_io_channel_unref(channel);
+
+	/* Jobs and info commands finish in the main loop */
+	if(sched != NULL)
+	{
+		loop = g_main_loop_new(NULL,FALSE);
+		g_timeout_add(BATCH_POLL,wait_jobs,sched);
+		g_main_loop_run(loop);
+		g_main_loop_unref(loop);
+		free_Scheduler(sched);
+	}
+
+	g_printerr("Loaded modules in %.1f ms\n",load * 1000);
+	g_printerr("%d sentences, %d understood\n",count,understood);
+	if(count > 0)
+		g_printerr("Parsing %.3f ms/sentence (%.0f sentences/s), running %.3f ms/sentence\n",
+				parsing * 1000 / count,parsing > 0 ? count / parsing : 0,
+				running * 1000 / count);
+
+	g_timer_destroy(timer);
+	free_MessageLog(messages);
+	free_Engine(eng);
+	return 0;
+}
+
+/* Application, module chain or information asked for */
+static gchar *describe_target(Sentence *sen)
+{
+	GString *target = g_string_new(NULL);
+	Sentence *stage = NULL;
+
+	switch(sen->type)
+	{
+		case 0:
+		case 1:
+			g_string_append(target,sen->application);
+			break;
+		case 3:
+			for(stage = sen;stage;stage = stage->next)
+			{
+				if(stage != sen) g_string_append(target," | ");
+				g_string_append(target,stage->module ? stage->module : "?");
+				if(stage->object != NULL)
+					g_string_append_printf(target," %s",stage->object);
+			}
+			break;
+		case 5:
+			g_string_append_printf(target,"%s.%s",sen->infoObject,sen->infoProperty);
+			break;
+		default:
+			if(sen->object != NULL) g_string_append(target,sen->object);
+			break;
+	}
+	if(target->len == 0) g_string_append(target,"-");
+	return g_string_free(target,FALSE);
+}
+
+static gboolean wait_jobs(gpointer data)
+{
+	Scheduler *sched = (Scheduler *)data;
+
+	messages_drain(sched->messages);
+	if(!scheduler_idle(sched) || !messages_idle(sched->messages)) return TRUE;
+	g_main_loop_quit(loop);
+	return FALSE;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the non-interactive batch mode
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+/* 
+ * Runs every sentence of file ("-" is stdin) without a window.
+ * Returns the exit status of the program.
+ */
+int run_batch(const gchar *file,gboolean dry_run);
+
+
+
+
+#endif
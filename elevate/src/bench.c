@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Microbenchmarks for the parser and the module loader.
+ *
+ * For every size a directory of synthetic modules (applications and
+ * modapps) is written, loaded with create_capabilities_at() and a
+ * synthetic corpus of sentences is parsed against it. Each size
+ * prints one JSON object per line on stdout so that results can be
+ * compared between builds:
+ *
+ * {"modules":1000,"load_ms":..,"ns_per_sentence":..,...}
+ *
+ * Run it with "make bench" in src/.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "messages.h"
+#include "engine.h"
+#include "files.h"
+#include "jobs.h"
+#include "score.h"
+#include "lang.h"
+#include "parser.h"
+
+#define DEFAULT_SIZES "100,1000,10000,100000"
+#define DEFAULT_SENTENCES 10000
+#define LOOKUPS 100000
+
+/* One in this many modules is a modapp, the rest are applications */
+#define MODAPP_EVERY 3
+
+static gchar *sizes = NULL;
+static gint sentences = DEFAULT_SENTENCES;
+static gchar *directory = NULL;
+static gboolean keep = FALSE;
+
+static GOptionEntry entries[] = 
+{
+	{ "sizes", 's', 0, G_OPTION_ARG_STRING, &sizes, "Module counts to test (default " DEFAULT_SIZES ")", "N,N,.." },
+	{ "sentences", 'n', 0, G_OPTION_ARG_INT, &sentences, "Sentences parsed for every size", "N" },
+	{ "dir", 'd', 0, G_OPTION_ARG_FILENAME, &directory, "Where synthetic modules are written (default $TMPDIR)", "DIR" },
+	{ "keep", 'k', 0, G_OPTION_ARG_NONE, &keep, "Do not delete the synthetic modules", NULL },
+	{ NULL }
+};
+
+/* Every malloc, calloc and realloc of the process is counted */
+static volatile gint allocations = 0;
+
+static void ignore_log(const gchar *domain,GLogLevelFlags level,const gchar *message,gpointer data);
+static gchar *write_modules(guint count);
+static void remove_modules(gchar *path);
+static gchar **make_corpus(guint modules,guint count);
+static gchar **make_keywords(guint modules,guint count);
+static void run_size(guint modules);
+static glong peak_rss(void);
+
+#ifdef __GLIBC__
+/*
+ * g_mem_set_vtable() does nothing since GLib 2.46, so malloc itself
+ * is replaced. GLib and the other libraries resolve to these before
+ * the C library, which still does the work.
+ */
+#define COUNT_ALLOCATIONS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count,size_t size);
+extern void *__libc_realloc(void *mem,size_t size);
+extern void __libc_free(void *mem);
+
+void *malloc(size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count,size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_calloc(count,size);
+}
+
+void *realloc(void *mem,size_t size)
+{
+	g_atomic_int_inc(&allocations);
+	return __libc_realloc(mem,size);
+}
+
+void free(void *mem)
+{
+	__libc_free(mem);
+}
+#endif
+
+int main(int argc,char *argv[])
+{
+	GOptionContext *options = NULL;
+	GError *error = NULL;
+	gchar **counts = NULL;
+	int i;
+
+	/* Older GLib keeps small blocks in its own slices */
+	g_setenv("G_SLICE","always-malloc",TRUE);
+
+	options = g_option_context_new("- parser and loader benchmarks");
+	g_option_context_add_main_entries(options,entries,NULL);
+	if(!g_option_context_parse(options,&argc,&argv,&error))
+	{
+		g_printerr("%s\n",error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(options);
+	if(directory == NULL) directory = g_strdup(g_get_tmp_dir());
+	if(sentences <= 0) sentences = DEFAULT_SENTENCES;
+
+	/* The parser logs every word it sees */
+	g_log_set_handler(NULL,G_LOG_LEVEL_DEBUG | G_LOG_LEVEL_INFO | G_LOG_LEVEL_MESSAGE,ignore_log,NULL);
+
+	counts = g_strsplit(sizes ? sizes : DEFAULT_SIZES,",",-1);
+	for(i=0;counts[i] != NULL;i++)
+	{
+		guint modules = g_ascii_strtoull(counts[i],NULL,10);
+		if(modules > 0) run_size(modules);
+	}
+	g_strfreev(counts);
+
+	return 0;
+}
+
+static void run_size(guint modules)
+{
+	gchar *path = NULL;
+	gchar **corpus = NULL;
+	gchar **keywords = NULL;
+	Engine *eng = NULL;
+	GTimer *timer = NULL;
+	gdouble load = 0;
+	gdouble parse = 0;
+	gdouble lookup = 0;
+	gdouble load_allocs = -1;
+	gdouble parse_allocs = -1;
+	guint understood = 0;
+	guint i;
+
+	path = write_modules(modules);
+	corpus = make_corpus(modules,sentences);
+	keywords = make_keywords(modules,LOOKUPS);
+	timer = g_timer_new();
+
+	/* Startup */
+	g_atomic_int_set(&allocations,0);
+	g_timer_start(timer);
+	eng = create_capabilities_at(path);
+	load = g_timer_elapsed(timer,NULL);
+#ifdef COUNT_ALLOCATIONS
+	load_allocs = (gdouble)g_atomic_int_get(&allocations) / modules;
+#endif
+
+	/* Parsing, process() and feed() */
+	g_atomic_int_set(&allocations,0);
+	g_timer_start(timer);
+	for(i=0;corpus[i] != NULL;i++)
+	{
+		Language *lang = parse_sentence(corpus[i],eng);
+		if(lang->sen->type >= 0) understood++;
+		free_Language(lang);
+	}
+	parse = g_timer_elapsed(timer,NULL);
+#ifdef COUNT_ALLOCATIONS
+	parse_allocs = (gdouble)g_atomic_int_get(&allocations) / sentences;
+#endif
+
+	/* Keyword lookups, half of them misses */
+	g_timer_start(timer);
+	for(i=0;keywords[i] != NULL;i++)
+		find_application(eng,keywords[i]);
+	lookup = g_timer_elapsed(timer,NULL);
+
+	printf("{\"modules\":%d,\"load_ms\":%.3f,\"allocs_per_module\":%.1f,"
+			"\"sentences\":%d,\"understood\":%d,\"ns_per_sentence\":%.0f,\"allocs_per_sentence\":%.1f,"
+			"\"ns_per_lookup\":%.1f,\"peak_rss_kb\":%ld}\n",
+			modules,load * 1000,load_allocs,
+			sentences,understood,parse * 1e9 / sentences,parse_allocs,
+			lookup * 1e9 / LOOKUPS,peak_rss());
+	fflush(stdout);
+
+	g_timer_destroy(timer);
+	free_Engine(eng);
+	g_strfreev(corpus);
+	g_strfreev(keywords);
+	if(!keep) remove_modules(path);
+	g_free(path);
+}
+
+/*
+ * Writes count modules. Applications are called appN and
+ * modapps modN with one implied argument taking the object.
+ */
+static gchar *write_modules(guint count)
+{
+	gchar *name = NULL;
+	gchar *path = NULL;
+	guint i;
+
+	name = g_strdup_printf("elevate-bench-%d-%d",(int)getpid(),count);
+	path = g_build_filename(directory,name,NULL);
+	g_free(name);
+	g_mkdir_with_parents(path,0700);
+
+	for(i=0;i<count;i++)
+	{
+		gchar *file = NULL;
+		gchar *contents = NULL;
+
+		if(i % MODAPP_EVERY == 0)
+		{
+			file = g_strdup_printf("%s/mod%d.modapp",path,i);
+			contents = g_strdup_printf(
+					"[General]\ndescription=Synthetic module %d\nkeyword=mod%d\ntype=module\n\n"
+					"[modapp]\ncommand=true\n\n"
+					"[Argument1]\ndescription=Input\nkeyword=with%d\noptional=no\nimplied=yes\n"
+					"parameter=yes\npattern=%%p\n",i,i,i);
+		}
+		else
+		{
+			file = g_strdup_printf("%s/app%d.app",path,i);
+			contents = g_strdup_printf(
+					"[General]\ndescription=Synthetic application %d\nkeyword=app%d,application%d\ntype=application\n\n"
+					"[app]\ncommand=true\n\n"
+					"[filetypes]\naccepts=single\nextensions=ext%d\ntriggers=view%d\n",i,i,i,i,i);
+		}
+		g_file_set_contents(file,contents,-1,NULL);
+		g_free(contents);
+		g_free(file);
+	}
+	return path;
+}
+
+static void remove_modules(gchar *path)
+{
+	GDir *dir = g_dir_open(path,0,NULL);
+	const gchar *next = NULL;
+
+	if(dir == NULL) return;
+	while((next = g_dir_read_name(dir)) != NULL)
+	{
+		gchar *file = g_build_filename(path,next,NULL);
+		g_unlink(file);
+		g_free(file);
+	}
+	g_dir_close(dir);
+	g_rmdir(path);
+}
+
+/* A mix of every kind of sentence the parser knows plus noise */
+static gchar **make_corpus(guint modules,guint count)
+{
+	gchar **result = g_new0(gchar *,count + 1);
+	GRand *rand = g_rand_new_with_seed(count);
+	guint i;
+
+	for(i=0;i<count;i++)
+	{
+		guint app = g_rand_int_range(rand,0,modules);
+		guint mod = (g_rand_int_range(rand,0,modules) / MODAPP_EVERY) * MODAPP_EVERY;
+		guint other = (g_rand_int_range(rand,0,modules) / MODAPP_EVERY) * MODAPP_EVERY;
+
+		switch(i % 6)
+		{
+			case 0:
+				result[i] = g_strdup_printf("app%d",app);
+				break;
+			case 1:
+				result[i] = g_strdup_printf("launch app%d",app);
+				break;
+			case 2:
+				result[i] = g_strdup_printf("mod%d report%d.pdf",mod,i);
+				break;
+			case 3:
+				result[i] = g_strdup_printf("mod%d data%d.txt then mod%d out%d.gz",mod,i,other,i);
+				break;
+			case 4:
+				result[i] = g_strdup_printf("open /tmp/file%d.txt",i);
+				break;
+			default:
+				result[i] = g_strdup_printf("please frobnicate the word%d now",i);
+				break;
+		}
+	}
+	g_rand_free(rand);
+	return result;
+}
+
+/*
+ * Keywords spread over every generated module. Hits name an
+ * application, misses a keyword nobody has.
+ */
+static gchar **make_keywords(guint modules,guint count)
+{
+	gchar **result = g_new0(gchar *,count + 1);
+	GRand *rand = g_rand_new_with_seed(modules);
+	guint i;
+
+	for(i=0;i<count;i++)
+	{
+		guint app = g_rand_int_range(rand,0,modules);
+
+		/* Modapps are not applications, take the next one */
+		if(app % MODAPP_EVERY == 0 && app + 1 < modules) app++;
+		if(i % 2)
+			result[i] = g_strdup_printf("app%d",app);
+		else
+			result[i] = g_strdup_printf("missing%d",app);
+	}
+	g_rand_free(rand);
+	return result;
+}
+
+static glong peak_rss(void)
+{
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF,&usage) != 0) return -1;
+	return usage.ru_maxrss;
+}
+
+static void ignore_log(const gchar *domain,GLogLevelFlags level,const gchar *message,gpointer data)
+{
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * "what can burn a cd" should find cdrecord. Every application,
+ * modapp, modapp argument and information entry becomes a document
+ * made of its keywords and its description. An inverted index maps
+ * each (lower case, lightly stemmed) term to the documents that
+ * contain it and questions are ranked with BM25.
+ *
+ * The index is built once for every Engine snapshot right after the
+ * modules are loaded, so it always matches what elevate knows.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "messages.h"
+#include "elevate_plugin.h"
+#include "info.h"
+#include "app.h"
+#include "modapp.h"
+#include "engine.h"
+#include "discover.h"
+
+/* BM25 parameters */
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+static const gchar *stop_words[] = {
+	"a","an","the","what","which","can","could","i","me","my","do","does",
+	"how","to","of","for","with","and","or","in","on","is","are","it","this",
+	"that","help","you","be","from","by","at","some",NULL
+};
+
+static void add_document(Index *index,gchar *name,const gchar *kind,const gchar *description,gchar **keywords);
+static void add_terms(Index *index,guint doc,const gchar *text,GHashTable *counts);
+static GSList *tokenize(const gchar *text);
+static gboolean is_stop_word(const gchar *word);
+static void collect_value(gpointer key,gpointer value,gpointer data);
+static GList *unique_values(GHashTable *table);
+static void free_postings(gpointer data);
+
+/* Constructor */
+Index* create_Index(Engine *eng)
+{
+	Index *result = NULL;
+	GList *values = NULL;
+	GList *iterator = NULL;
+	gdouble total = 0;
+	guint i;
+
+	result = g_new0(Index,1);
+	result->docs = g_array_new(FALSE,FALSE,sizeof(Capability));
+	result->terms = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,free_postings);
+
+	values = unique_values(eng->apps);
+	for(iterator = values;iterator;iterator = iterator->next)
+	{
+		App *app = iterator->data;
+		if(!app->available) continue;
+		add_document(result,g_strdup(app->keyword[0]),"application",app->description,app->keyword);
+	}
+	g_list_free(values);
+
+	values = unique_values(eng->modules);
+	for(iterator = values;iterator;iterator = iterator->next)
+	{
+		Modapp *mod = iterator->data;
+		GSList *arg_it = NULL;
+
+		if(!mod->available) continue;
+		add_document(result,g_strdup(mod->keyword[0]),"module",mod->description,mod->keyword);
+		for(arg_it = mod->order;arg_it;arg_it = arg_it->next)
+		{
+			Arg *arg = arg_it->data;
+			if(arg->description == NULL) continue;
+			add_document(result,g_strdup_printf("%s %s",mod->keyword[0],arg->keyword[0]),
+					"argument",arg->description,arg->keyword);
+		}
+	}
+	g_list_free(values);
+
+	values = unique_values(eng->infos);
+	for(iterator = values;iterator;iterator = iterator->next)
+	{
+		Info *info = iterator->data;
+		add_document(result,g_strdup(info->object[0]),"information",info->description,info->property);
+	}
+	g_list_free(values);
+
+	for(i=0;i<result->docs->len;i++)
+		total += g_array_index(result->docs,Capability,i).terms;
+	if(result->docs->len > 0) result->average_terms = total / result->docs->len;
+
+	g_debug("Indexed %d capabilities with %d terms",result->docs->len,g_hash_table_size(result->terms));
+	return result;
+}
+
+guint index_search(const Index *index,const gchar *query,Hit *hits,guint max)
+{
+	GSList *words = NULL;
+	GSList *iterator = NULL;
+	gdouble *scores = NULL;
+	GArray *touched = NULL;
+	guint n = index->docs->len;
+	guint count = 0;
+	guint i;
+
+	if(n == 0 || max == 0) return 0;
+
+	scores = g_new0(gdouble,n);
+	touched = g_array_new(FALSE,FALSE,sizeof(guint));
+
+	words = tokenize(query);
+	for(iterator = words;iterator;iterator = iterator->next)
+	{
+		GArray *postings = g_hash_table_lookup(index->terms,iterator->data);
+		gdouble idf;
+
+		if(postings == NULL) continue;
+		idf = log(1 + (n - postings->len + 0.5) / (postings->len + 0.5));
+
+		for(i=0;i<postings->len;i++)
+		{
+			Posting *post = &g_array_index(postings,Posting,i);
+			const Capability *cap = &g_array_index(index->docs,Capability,post->doc);
+			gdouble norm = 1 - BM25_B + BM25_B * cap->terms / index->average_terms;
+
+			if(scores[post->doc] == 0) g_array_append_val(touched,post->doc);
+			scores[post->doc] += idf * post->count * (BM25_K1 + 1) / (post->count + BM25_K1 * norm);
+		}
+	}
+	g_slist_foreach(words,(GFunc)g_free,NULL);
+	g_slist_free(words);
+
+	/* Keep the best max documents, ordered */
+	for(i=0;i<touched->len;i++)
+	{
+		guint doc = g_array_index(touched,guint,i);
+		guint slot;
+
+		for(slot = count;slot > 0 && hits[slot - 1].score < scores[doc];slot--)
+			if(slot < max) hits[slot] = hits[slot - 1];
+		if(slot >= max) continue;
+
+		hits[slot].capability = &g_array_index(index->docs,Capability,doc);
+		hits[slot].score = scores[doc];
+		if(count < max) count++;
+	}
+
+	g_array_free(touched,TRUE);
+	g_free(scores);
+	return count;
+}
+
+/* Destructor */
+void free_Index(Index *index)
+{
+	guint i;
+
+	for(i=0;i<index->docs->len;i++)
+		g_free((gchar *)g_array_index(index->docs,Capability,i).name);
+	g_array_free(index->docs,TRUE);
+	g_hash_table_destroy(index->terms);
+	g_free(index);
+}
+
+/* The index owns name */
+static void add_document(Index *index,gchar *name,const gchar *kind,const gchar *description,gchar **keywords)
+{
+	Capability cap;
+	GHashTable *counts = NULL;
+	GHashTableIter iter;
+	gpointer term;
+	gpointer count;
+	guint doc = index->docs->len;
+	int i;
+
+	cap.name = name;
+	cap.kind = kind;
+	cap.description = description;
+	cap.terms = 0;
+
+	/* Term frequencies of this document first */
+	counts = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,NULL);
+	add_terms(index,doc,description,counts);
+	for(i=0;keywords != NULL && keywords[i] != NULL;i++)
+		add_terms(index,doc,keywords[i],counts);
+
+	g_hash_table_iter_init(&iter,counts);
+	while(g_hash_table_iter_next(&iter,&term,&count))
+	{
+		GArray *postings = g_hash_table_lookup(index->terms,term);
+		Posting post;
+
+		if(postings == NULL)
+		{
+			postings = g_array_new(FALSE,FALSE,sizeof(Posting));
+			g_hash_table_insert(index->terms,g_strdup(term),postings);
+		}
+		post.doc = doc;
+		post.count = MIN(GPOINTER_TO_UINT(count),G_MAXUINT16);
+		g_array_append_val(postings,post);
+		cap.terms += post.count;
+	}
+	g_hash_table_destroy(counts);
+
+	g_array_append_val(index->docs,cap);
+}
+
+static void add_terms(Index *index,guint doc,const gchar *text,GHashTable *counts)
+{
+	GSList *words = tokenize(text);
+	GSList *iterator = NULL;
+
+	for(iterator = words;iterator;iterator = iterator->next)
+	{
+		guint count = GPOINTER_TO_UINT(g_hash_table_lookup(counts,iterator->data));
+		/* The table takes the word */
+		g_hash_table_replace(counts,iterator->data,GUINT_TO_POINTER(count + 1));
+	}
+	g_slist_free(words);
+}
+
+/*
+ * Lower case words without stop words. A plural "s" is dropped
+ * so that "burns" and "cds" match "burn" and "cd".
+ */
+static GSList *tokenize(const gchar *text)
+{
+	GSList *result = NULL;
+	GString *word = NULL;
+	const gchar *p = NULL;
+
+	if(text == NULL) return NULL;
+
+	word = g_string_new(NULL);
+	for(p = text;;p++)
+	{
+		if(*p != '\0' && g_ascii_isalnum(*p))
+		{
+			g_string_append_c(word,g_ascii_tolower(*p));
+			continue;
+		}
+		if(word->len > 3 && word->str[word->len - 1] == 's' && word->str[word->len - 2] != 's')
+			g_string_truncate(word,word->len - 1);
+		else if(word->len == 3 && word->str[2] == 's' && g_ascii_isdigit(word->str[0]) == FALSE)
+			g_string_truncate(word,word->len - 1);
+		if(word->len > 0 && !is_stop_word(word->str))
+			result = g_slist_prepend(result,g_strdup(word->str));
+		g_string_truncate(word,0);
+		if(*p == '\0') break;
+	}
+	g_string_free(word,TRUE);
+	return g_slist_reverse(result);
+}
+
+static gboolean is_stop_word(const gchar *word)
+{
+	int i;
+
+	for(i=0;stop_words[i] != NULL;i++)
+		if(strcmp(word,stop_words[i]) == 0) return TRUE;
+	return FALSE;
+}
+
+static void collect_value(gpointer key,gpointer value,gpointer data)
+{
+	g_hash_table_insert((GHashTable *)data,value,value);
+}
+
+/* Every App/Modapp/Info is stored once for each of its keywords */
+static GList *unique_values(GHashTable *table)
+{
+	GHashTable *unique = g_hash_table_new(g_direct_hash,g_direct_equal);
+	GList *result = NULL;
+
+	g_hash_table_foreach(table,collect_value,unique);
+	result = g_hash_table_get_keys(unique);
+	g_hash_table_destroy(unique);
+	return result;
+}
+
+static void free_postings(gpointer data)
+{
+	g_array_free((GArray *)data,TRUE);
+}
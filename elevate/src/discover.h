@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the search over module descriptions
+ */
+
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+/* Results shown for a question */
+#define DISCOVER_RESULTS 5
+
+typedef struct capability
+{
+	const gchar *name; /* Keyword the user types */
+	const gchar *kind; /* application, module, argument, information */
+	const gchar *description; /* Owned by the App/Modapp/Arg/Info */
+	guint terms; /* Words in the description (for length normalisation) */
+}Capability;
+
+typedef struct posting
+{
+	guint doc; /* Index in docs */
+	guint16 count; /* Times the term appears */
+}Posting;
+
+typedef struct capability_index
+{
+	GArray *docs; /* Capability */
+	GHashTable *terms; /* term -> GArray of Posting, docs ascending */
+	gdouble average_terms;
+}Index;
+
+typedef struct discovery_hit
+{
+	const Capability *capability;
+	gdouble score;
+}Hit;
+
+/* Constructor. Indexes every description of the engine */
+Index* create_Index(Engine *eng);
+
+/* Fills hits with at most max results, best first. Returns how many */
+guint index_search(const Index *index,const gchar *query,Hit *hits,guint max);
+
+/* Destructor */
+void free_Index(Index *index);
+
+
+
+
+#endif
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <malloc.h>
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -31,9 +32,15 @@
 
 #include <cairo.h>
 
+#include "messages.h"
 #include "gfx.h"
 #include "integrator.h"
 #include "engine.h"
+#include "jobs.h"
+#include "speculate.h"
+#include "hotkey.h"
+#include "history.h"
+#include "batch.h"
 #include "parser.h"
 #include "files.h"
 
@@ -41,13 +48,33 @@
 #define HEIGHT 800
 #define WIDTH 800
 
+/* Animation runs at 25fps */
+#define FRAME_INTERVAL 40
+
+/* How often $PATH is checked for new or removed programs */
+#define PATH_INTERVAL 5000
+
+#define CONFIG_FILE "elevate.conf"
+#define RESIDENT_G "resident"
+#define HOTKEY_P "hotkey"
+#define DEFAULT_HOTKEY "<Super>space"
+
+/* Command log under ~/.elevate */
+#define HISTORY_FILE "history"
+
 /* 
  * Non-Gui stuff goes here 
  */
 typedef struct data_model
 {
 	char cmd[80];
-	Engine *engine;
+	MessageLog *messages; /* Output of commands */
+	Scheduler *jobs; /* Running and queued modapps */
+	Speculator *speculator; /* Prewarms while typing */
+	History *history; /* Previous commands */
+	guint recall; /* Entry shown by Up/Down, history length when none */
+	char search[80]; /* Reverse search query */
+	gint found; /* Entry matching the query or -1 */
 }dm_t;
 
 /*
@@ -58,11 +85,29 @@ typedef struct win {
 	dm_t dm; //Data model
 	gint mode; //What state is the interface now (e.g. input or not)
 	Integrator *input_box_fx; /* Percent*/
+
+	/* Resident mode */
+	gboolean resident; /* Hide instead of quitting */
+	Hotkey *hotkey; /* Shows the hidden window */
+	guint timer; /* Animation timer, only while visible */
+	GTimer *summon; /* From hotkey to first frame */
+	gboolean summoning;
+	gdouble worst_summon; /* Slowest summon in seconds */
+	cairo_surface_t *background; /* Cached static contents, on the X server */
+	gint background_width;
+	gint background_height;
+
+	/* Startup */
+	GTimer *startup; /* Since main() */
+	gboolean drawn; /* First frame is on screen */
+	GQueue *pending; /* Sentences typed before the engine was ready */
+	gboolean reloading; /* A new engine is being loaded */
 } win_t;
 
 /* Possible modes */
 #define MODE_NORMAL 1
 #define MODE_INPUT 2
+#define MODE_SEARCH 3
 
 
 
@@ -76,6 +121,29 @@ static gint on_key_press (GtkWidget * widget, GdkEventKey * event, gpointer data
 static GtkWidget *create_window (win_t *as);
 static gint timeout_callback (gpointer data);
 static void draw_status(cairo_t *cr,win_t *win);
+static void show_window(win_t *win);
+static void hide_window(win_t *win);
+static void on_hotkey(gpointer data);
+static gboolean on_delete(GtkWidget *widget,GdkEvent *event,gpointer data);
+static gchar *read_hotkey(void);
+static gpointer load_engine(gpointer data);
+static gboolean on_engine_ready(gpointer data);
+static gboolean on_path_check(gpointer data);
+static void recall_history(win_t *win,gint step);
+static void search_history(win_t *win,gint before);
+static gboolean on_search_key(win_t *win,GdkEventKey *event);
+
+static gboolean resident = FALSE;
+static gchar *batch = NULL;
+static gboolean dry_run = FALSE;
+
+static GOptionEntry entries[] = 
+{
+	{ "resident", 'r', 0, G_OPTION_ARG_NONE, &resident, "Stay in memory and show the window with a hotkey", NULL },
+	{ "batch", 'b', 0, G_OPTION_ARG_FILENAME, &batch, "Run the sentences of FILE (- for stdin) without a window", "FILE" },
+	{ "dry-run", 'n', 0, G_OPTION_ARG_NONE, &dry_run, "With --batch, describe commands instead of running them", NULL },
+	{ NULL }
+};
 
 /*
  * Reads all modules from the filesystem 
@@ -84,13 +152,40 @@ static void draw_status(cairo_t *cr,win_t *win);
 int main (int argc, char *argv[])
 {
 	win_t closure;
+	GError *error = NULL;
+	GOptionContext *options = NULL;
+	gchar *history_path = NULL;
+
+	/* Engine snapshots can be published from other threads */
+	if(!g_thread_supported()) g_thread_init(NULL);
+
+	/* Batch mode must work without a display */
+	options = g_option_context_new("- Project Elevate");
+	g_option_context_add_main_entries(options,entries,NULL);
+	g_option_context_add_group(options,gtk_get_option_group(FALSE));
+	if(!g_option_context_parse(options,&argc,&argv,&error))
+	{
+		g_printerr("%s\n",error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(options);
+	if(batch != NULL) return run_batch(batch,dry_run);
 
 	gtk_init (&argc, &argv);
+	memset(&closure,0,sizeof(win_t));
+	closure.startup = g_timer_new();
+	closure.pending = g_queue_new();
 
-
-	/* Elevate modules */
-	closure.dm.engine = create_capabilities();
 	closure.dm.cmd[0]='\0';
+	closure.dm.messages = create_MessageLog();
+	closure.dm.jobs = create_Scheduler(closure.dm.messages);
+	closure.dm.speculator = create_Speculator();
+	history_path = elevate_user_path(HISTORY_FILE);
+	if(history_path != NULL) closure.dm.history = create_History(history_path);
+	else closure.dm.history = create_History(HISTORY_FILE);
+	g_free(history_path);
+	closure.dm.recall = history_length(closure.dm.history);
 	/* GUI init */
 	closure.drawing_area = create_window (&closure);
 	closure.mode = MODE_NORMAL;
@@ -100,14 +195,42 @@ int main (int argc, char *argv[])
 	Integrator_set(closure.input_box_fx,0);
 	Integrator_target(closure.input_box_fx,101); //this is percent that we need to reach until 100
 
-	/* Show the GUI to the user */
-	gtk_widget_show_all (gtk_widget_get_toplevel (closure.drawing_area));
-	
-	/* Create animation thread at 25fps*/
-	g_timeout_add (40, timeout_callback, &closure);
+	/*
+	 * A resident elevate keeps its engine and a realised window
+	 * and waits for the hotkey. If the hotkey cannot be grabbed
+	 * it behaves like a normal one.
+	 */
+	closure.summon = g_timer_new();
+	if(resident)
+	{
+		gchar *accelerator = read_hotkey();
+		closure.hotkey = create_Hotkey(accelerator,on_hotkey,&closure);
+		g_free(accelerator);
+	}
+	closure.resident = (closure.hotkey != NULL);
+	gtk_widget_realize(gtk_widget_get_toplevel(closure.drawing_area));
+	if(!closure.resident) show_window(&closure);
+
+	/* 
+	 * Elevate modules are read while the window is already up.
+	 * The engine is published when done.
+	 */
+	if(g_thread_create(load_engine,&closure,FALSE,&error) == NULL)
+	{
+		g_warning("Could not start loader thread: %s",error->message);
+		g_error_free(error);
+		load_engine(&closure);
+	}
+	g_timeout_add(PATH_INTERVAL,on_path_check,&closure);
 
 	gtk_main();
 
+	if(closure.hotkey != NULL) free_Hotkey(closure.hotkey);
+	if(closure.worst_summon > 0)
+		g_message("Slowest summon took %.1f ms",closure.worst_summon * 1000);
+	free_Speculator(closure.dm.speculator);
+	free_Scheduler(closure.dm.jobs);
+	free_History(closure.dm.history);
 	return 0;
 }
 
@@ -160,18 +283,45 @@ static void draw_background(cairo_t *cr)
 static void draw_canvas(GtkWidget *widget,win_t *win)
 {
 	cairo_t *cr;
+	gint width, height;
 
+	gdk_drawable_get_size (widget->window, &width, &height);
 	cr = begin_paint (widget->window);
+
+	/* Step 1 Static window contents (drawn once per size) */
+	if(win->background != NULL &&
+			(win->background_width != width || win->background_height != height))
+	{
+		cairo_surface_destroy(win->background);
+		win->background = NULL;
+	}
+	if(win->background == NULL)
+	{
+		cairo_t *bg;
+
+		/* A pixmap like the window, so frames never upload it again */
+		win->background = cairo_surface_create_similar(cairo_get_target(cr),
+				CAIRO_CONTENT_COLOR,width,height);
+		win->background_width = width;
+		win->background_height = height;
+		bg = cairo_create(win->background);
+		scale_for_aspect_ratio(bg,width,height);
+		cairo_scale(bg,WIDTH/100,HEIGHT/100);
+		draw_background(bg);
+		cairo_destroy(bg);
+	}
+	cairo_save(cr);
+	cairo_identity_matrix(cr);
+	cairo_set_source_surface(cr,win->background,0,0);
+	cairo_paint(cr);
+	cairo_restore(cr);
+
 	/*
 	 * Scale the canvas so that all co-ordinates
 	 * can be 0-100 regardless of the size of the window
 	 */
 	cairo_scale(cr,WIDTH/100,HEIGHT/100);
 
-
-	/* Step 1 Static window contents */
-	draw_background(cr);
-
 	/* Step 2 Draw messages, tasks and context */
 	draw_status(cr,win);
 
@@ -180,8 +330,21 @@ static void draw_canvas(GtkWidget *widget,win_t *win)
 
 static void draw_status(cairo_t *cr,win_t *win)
 {
-	/* First the output messages */
-	draw_messages_box(cr,"Messages go here",5);
+	const gchar *lines[MESSAGE_ROWS];
+	guint count = 0;
+	gchar *summary = NULL;
+
+	/* First the output messages (only the visible ones) */
+	count = messages_window(win->dm.messages,lines,MESSAGE_ROWS);
+	draw_messages_box(cr,lines,count);
+
+	/* Jobs go in the window status box */
+	if(engine_current() == NULL)
+		summary = g_strdup("Loading modules...");
+	else
+		summary = scheduler_summary(win->dm.jobs);
+	show_text_message(cr,3,50,3,summary,1.0);
+	g_free(summary);
 
 
 
@@ -191,6 +354,13 @@ static void draw_status(cairo_t *cr,win_t *win)
 		gfloat fx_number = Integrator_get(win->input_box_fx);
 		draw_input_box (cr, win->dm.cmd, fx_number /100.0); //Convert it to percent
 	}
+	if(win->mode == MODE_SEARCH)
+	{
+		gchar *line = g_strdup_printf("search `%s'%s: %s",win->dm.search,
+				win->dm.found < 0 && win->dm.search[0] != '\0' ? " (not found)" : "",win->dm.cmd);
+		draw_input_box (cr, line, Integrator_get(win->input_box_fx) /100.0);
+		g_free(line);
+	}
 }
 
 /*
@@ -201,20 +371,58 @@ static gint on_key_press (GtkWidget * widget, GdkEventKey * event, gpointer data
 	win_t *closure = (win_t *)data;
 	gchar *input = NULL;
 
+	/* Ctrl-R searches backwards, again for an older match */
+	if((event->state & GDK_CONTROL_MASK) && event->keyval == GDK_r)
+	{
+		if(closure->mode != MODE_SEARCH)
+		{
+			closure->mode = MODE_SEARCH;
+			closure->dm.search[0] = '\0';
+			closure->dm.found = -1;
+		}
+		else if(closure->dm.found > 0) search_history(closure,closure->dm.found);
+		return TRUE;
+	}
+	if(closure->mode == MODE_SEARCH && on_search_key(closure,event)) return TRUE;
+
 	switch (event->keyval)
 	{
+		case GDK_Up:
+			recall_history(closure,-1);
+			break;
+		case GDK_Down:
+			recall_history(closure,1);
+			break;
 		case GDK_Escape:
 			memset(closure->dm.cmd,0,80); //Clear the command line
 			closure->mode = MODE_NORMAL;
+			closure->dm.recall = history_length(closure->dm.history);
+			if(closure->resident) hide_window(closure);
 			break;
 		case GDK_BackSpace:
 			if(strlen(closure->dm.cmd) > 0)
 				closure->dm.cmd[strlen(closure->dm.cmd)-1] = '\0';
 			break;
+		case GDK_Page_Up:
+			messages_scroll(closure->dm.messages,MESSAGE_ROWS);
+			break;
+		case GDK_Page_Down:
+			messages_scroll(closure->dm.messages,-MESSAGE_ROWS);
+			break;
 		case GDK_Return:
 			input = g_strdup(closure->dm.cmd);
 			memset(closure->dm.cmd,0,80); //Clear the command line
-			start_parsing(input,closure->dm.engine);
+			history_add(closure->dm.history,input);
+			closure->dm.recall = history_length(closure->dm.history);
+			if(engine_current() == NULL)
+			{
+				/* Parsed as soon as the modules are loaded */
+				g_queue_push_tail(closure->pending,input);
+				closure->mode = MODE_NORMAL;
+				break;
+			}
+			speculate_commit(closure->dm.speculator,engine_current(),input);
+			start_parsing(input,engine_current(),closure->dm.jobs,closure->dm.messages);
 			g_free(input);
 			closure->mode = MODE_NORMAL;
 			break;
@@ -226,6 +434,9 @@ static gint on_key_press (GtkWidget * widget, GdkEventKey * event, gpointer data
 			break;
 	}
 	g_print("command is now %s\n",closure->dm.cmd);
+
+	/* Warm up what the sentence so far will need */
+	speculate_guess(closure->dm.speculator,engine_current(),closure->dm.cmd);
 	return TRUE;
 }
 
@@ -282,6 +493,24 @@ static gboolean win_expose_event (GtkWidget *widget, GdkEventExpose *event, gpoi
 
 	draw_canvas(widget,closure);
 
+	if(!closure->drawn)
+	{
+		closure->drawn = TRUE;
+		g_message("First frame after %.1f ms",g_timer_elapsed(closure->startup,NULL) * 1000);
+	}
+
+	/* The first frame after the hotkey ends the summon */
+	if(closure->summoning)
+	{
+		gdouble elapsed = g_timer_elapsed(closure->summon,NULL);
+
+		closure->summoning = FALSE;
+		closure->worst_summon = MAX(closure->worst_summon,elapsed);
+		g_debug("Summoned in %.1f ms",elapsed * 1000);
+		if(elapsed * 1000 > FRAME_INTERVAL)
+			g_warning("Summon took %.1f ms, more than one frame",elapsed * 1000);
+	}
+
 	return TRUE;
 }
 
@@ -299,6 +528,7 @@ static GtkWidget *create_window (win_t *as)
 
 	g_signal_connect (window, "destroy",
 			G_CALLBACK (gtk_main_quit), &window);
+	g_signal_connect (window, "delete_event", G_CALLBACK (on_delete), as);
 
 	da = gtk_drawing_area_new ();
 	/* set a minimum size */
@@ -327,9 +557,241 @@ static gint timeout_callback (gpointer data)
 	/* Advance all integrators */
 	Integrator_update(closure->input_box_fx);
 
+	/* Pick up lines posted by worker threads */
+	messages_drain(closure->dm.messages);
+
 	gtk_widget_queue_draw (closure->drawing_area);
 
 	return TRUE; //Keep this timer active
 }
 
+/*
+ * Maps the window and starts the animation
+ */
+static void show_window(win_t *win)
+{
+	if(win->timer == 0)
+		win->timer = g_timeout_add (FRAME_INTERVAL, timeout_callback, win);
+	gtk_widget_show_all (gtk_widget_get_toplevel (win->drawing_area));
+	gtk_window_present (GTK_WINDOW (gtk_widget_get_toplevel (win->drawing_area)));
+}
+
+/*
+ * Unmaps the window of a resident elevate. Nothing is
+ * drawn while hidden so the animation stops and the cached
+ * background is given back.
+ */
+static void hide_window(win_t *win)
+{
+	gtk_widget_hide (gtk_widget_get_toplevel (win->drawing_area));
+	if(win->timer != 0)
+	{
+		g_source_remove(win->timer);
+		win->timer = 0;
+	}
+	if(win->background != NULL)
+	{
+		cairo_surface_destroy(win->background);
+		win->background = NULL;
+	}
+	malloc_trim(0);
+}
+
+static void on_hotkey(gpointer data)
+{
+	win_t *win = (win_t *)data;
+
+	if(GTK_WIDGET_VISIBLE(gtk_widget_get_toplevel(win->drawing_area)))
+	{
+		hide_window(win);
+		return;
+	}
+	g_timer_start(win->summon);
+	win->summoning = TRUE;
+	show_window(win);
+}
+
+/*
+ * Closing the window of a resident elevate only hides it
+ */
+static gboolean on_delete(GtkWidget *widget,GdkEvent *event,gpointer data)
+{
+	win_t *win = (win_t *)data;
+
+	if(!win->resident) return FALSE;
+	hide_window(win);
+	return TRUE;
+}
+
+/*
+ * Reads the hotkey from ~/.elevate/elevate.conf
+ *
+ * [resident]
+ * hotkey = <Control><Alt>space
+ */
+static gchar *read_hotkey(void)
+{
+	GKeyFile *config = NULL;
+	gchar *path = NULL;
+	gchar *hotkey = NULL;
+
+	path = elevate_user_path(CONFIG_FILE);
+	config = g_key_file_new();
+	if(path != NULL && g_key_file_load_from_file(config,path,G_KEY_FILE_NONE,NULL))
+		hotkey = g_key_file_get_string(config,RESIDENT_G,HOTKEY_P,NULL);
+	g_key_file_free(config);
+	g_free(path);
+
+	if(hotkey == NULL) hotkey = g_strdup(DEFAULT_HOTKEY);
+	return hotkey;
+}
+
+/*
+ * Loader thread. Reads all modules and publishes the engine.
+ * It is the only thread that posts to the message log.
+ */
+static gpointer load_engine(gpointer data)
+{
+	win_t *win = (win_t *)data;
+	Engine *eng = NULL;
+	GTimer *timer = g_timer_new();
+	gchar *line = NULL;
+
+	eng = create_capabilities();
+	line = g_strdup_printf("Loaded %d capabilities in %.0f ms",
+			g_slist_length(eng->knowledge),g_timer_elapsed(timer,NULL) * 1000);
+	messages_post(win->dm.messages,line);
+	g_free(line);
+	g_timer_destroy(timer);
+
+	engine_publish(eng);
+	g_idle_add(on_engine_ready,data);
+	return NULL;
+}
+
+/*
+ * Programs installed or removed after startup change what
+ * elevate can do. Only the $PATH directories that changed
+ * are listed again, then a new engine is loaded.
+ */
+static gboolean on_path_check(gpointer data)
+{
+	win_t *win = (win_t *)data;
+	GError *error = NULL;
+
+	if(engine_current() == NULL || win->reloading) return TRUE;
+	if(!capabilities_outdated()) return TRUE;
+
+	g_debug("$PATH changed, loading modules again");
+	win->reloading = TRUE;
+	if(g_thread_create(load_engine,win,FALSE,&error) == NULL)
+	{
+		g_warning("Could not start loader thread: %s",error->message);
+		g_error_free(error);
+		win->reloading = FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Up and Down walk the history. Going past the newest
+ * entry gives an empty command line.
+ */
+static void recall_history(win_t *win,gint step)
+{
+	guint length = history_length(win->dm.history);
+	gchar *entry = NULL;
+
+	if(step < 0 && win->dm.recall == 0) return;
+	if(step > 0 && win->dm.recall >= length) return;
+	win->dm.recall += step;
+
+	memset(win->dm.cmd,0,80);
+	if(win->dm.recall < length)
+	{
+		entry = history_entry(win->dm.history,win->dm.recall);
+		g_strlcpy(win->dm.cmd,entry,80);
+		g_free(entry);
+	}
+	win->mode = MODE_INPUT;
+}
+
+/* Looks for the query in the entries older than before */
+static void search_history(win_t *win,gint before)
+{
+	gint found = history_search(win->dm.history,win->dm.search,before);
+	gchar *entry = NULL;
+
+	win->dm.found = found;
+	if(found < 0) return;
+
+	entry = history_entry(win->dm.history,found);
+	memset(win->dm.cmd,0,80);
+	g_strlcpy(win->dm.cmd,entry,80);
+	g_free(entry);
+	win->dm.recall = found;
+}
+
+/*
+ * Keys while searching. Typing refines the query, Escape keeps the
+ * match for editing and Return runs it. Returns FALSE for keys that
+ * are handled as usual.
+ */
+static gboolean on_search_key(win_t *win,GdkEventKey *event)
+{
+	gsize length = strlen(win->dm.search);
 
+	switch (event->keyval)
+	{
+		case GDK_BackSpace:
+			if(length > 0) win->dm.search[length - 1] = '\0';
+			search_history(win,history_length(win->dm.history));
+			return TRUE;
+		case GDK_Escape:
+			win->mode = MODE_INPUT;
+			return TRUE;
+		case GDK_Return:
+			return FALSE;
+		default:
+			break;
+	}
+	if(event->length == 0 || g_ascii_iscntrl(event->string[0]))
+	{
+		win->mode = MODE_INPUT;
+		return FALSE;
+	}
+
+	g_strlcat(win->dm.search,event->string,80);
+	/* The current match is kept while it still matches */
+	if(win->dm.found >= 0) search_history(win,win->dm.found + 1);
+	else search_history(win,history_length(win->dm.history));
+	return TRUE;
+}
+
+/*
+ * Runs in the GTK thread once the engine is published and
+ * parses everything typed in the meantime
+ */
+static gboolean on_engine_ready(gpointer data)
+{
+	win_t *win = (win_t *)data;
+	gchar *input = NULL;
+
+	if(win->reloading)
+	{
+		g_message("Modules reloaded");
+		win->reloading = FALSE;
+	}
+	else
+		g_message("Ready after %.1f ms",g_timer_elapsed(win->startup,NULL) * 1000);
+
+	while((input = g_queue_pop_head(win->pending)) != NULL)
+	{
+		start_parsing(input,engine_current(),win->dm.jobs,win->dm.messages);
+		g_free(input);
+	}
+	/* Guess again now that modules are known */
+	speculate_guess(win->dm.speculator,engine_current(),win->dm.cmd);
+
+	return FALSE;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * ABI for native information providers.
+ *
+ * A plugin is a shared object that elevate loads with GModule. It
+ * answers information queries in-process instead of running an
+ * external command for each one. A plugin must export
+ *
+ *	gint elevate_plugin_abi(void);
+ *
+ * returning ELEVATE_PLUGIN_ABI, plus one InfoQuery function for each
+ * symbol named in its module file. For example
+ *
+ *	[General]
+ *	description = system information
+ *	keyword = system info
+ *	type = plugin
+ *
+ *	[plugin]
+ *	library = libsysinfo.so
+ *
+ *	[Info1]
+ *	object = processor cpu
+ *	property = speed type megaherz
+ *	symbol = sysinfo_cpu
+ *	command = cat /proc/cpuinfo
+ *
+ * The command is optional and is only used if the plugin cannot be
+ * loaded. A library without a path is looked up in PLUGINDIR
+ * ($(pkglibdir)/plugins). sysinfo.c is the plugin shipped with elevate.
+ */
+
+#ifndef ELEVATE_PLUGIN_H
+#define ELEVATE_PLUGIN_H
+
+#include <glib.h>
+
+#define ELEVATE_PLUGIN_ABI 1
+#define ELEVATE_PLUGIN_ABI_SYMBOL "elevate_plugin_abi"
+
+typedef enum info_type
+{
+	INFO_NONE,
+	INFO_INT,
+	INFO_DOUBLE,
+	INFO_STRING
+}InfoType;
+
+typedef struct info_value
+{
+	InfoType type;
+	gint64 integer;
+	gdouble real;
+	gchar *string; /* Allocated with g_malloc. Elevate frees it */
+	const gchar *unit; /* Static string such as "MHz" or NULL */
+}InfoValue;
+
+/*
+ * Answers a query such as object="memory" property="free".
+ * property can be NULL. Returns FALSE if nothing is known.
+ */
+typedef gboolean (*InfoQuery)(const gchar *object,const gchar *property,InfoValue *result);
+
+typedef gint (*InfoAbi)(void);
+
+#endif
@@ -18,11 +18,41 @@
  * Project Elevate - Core 
  */
 #include <glib.h>
+#include <gmodule.h>
 
+#include "messages.h"
+#include "elevate_plugin.h"
+#include "info.h"
 #include "app.h"
 #include "modapp.h"
+#include "score.h"
+#include "fuzzy.h"
 #include "engine.h"
+#include "discover.h"
 
+/*
+ * The Engine seen by the GUI is an immutable snapshot. Loaders build
+ * a complete new Engine on their own thread and publish it by swapping
+ * a single pointer. Nothing is changed inside a published Engine.
+ *
+ * The GTK thread reads the snapshot through engine_current() without
+ * any locking. The pointer stays valid until control returns to the
+ * main loop, because replaced snapshots are only retired from an idle
+ * callback on that same thread (the grace period in RCU terms).
+ *
+ * Other threads that keep a snapshot for longer use engine_acquire()
+ * and engine_release(). A retired snapshot is freed when the last
+ * reference goes away.
+ */
+static volatile gpointer current = NULL;
+
+/* Snapshots replaced but not yet retired */
+G_LOCK_DEFINE_STATIC(retired);
+static GSList *retired = NULL;
+
+static gboolean retire_snapshots(gpointer data);
+static void collect_value(gpointer key,gpointer value,gpointer unique);
+static void free_Knowledge(gpointer data,gpointer unused);
 
 /* Constructor */
 Engine* create_Engine(void)
@@ -33,23 +63,111 @@ Engine* create_Engine(void)
 	result->knowledge = NULL;
 	result->apps = g_hash_table_new(g_str_hash,g_str_equal); 
 	result->modules = g_hash_table_new(g_str_hash,g_str_equal); 
+	result->infos = g_hash_table_new(g_str_hash,g_str_equal); 
+	result->properties = g_hash_table_new(g_str_hash,g_str_equal); 
+	result->plugins = NULL;
+	result->weights = create_Weights();
+	result->vocabulary = NULL;
+	result->index = NULL;
+	result->ref_count = 1; /* Owned by whoever publishes it */
 
 	return result;
 }
 
+/*
+ * Makes eng the current snapshot. Can be called from any thread.
+ * The caller gives its reference to the snapshot list.
+ */
+void engine_publish(Engine *eng)
+{
+	gpointer old = NULL;
+
+	do
+	{
+		old = g_atomic_pointer_get(&current);
+	}
+	while(!g_atomic_pointer_compare_and_exchange(&current,old,eng));
+
+	if(old == NULL) return;
+
+	G_LOCK(retired);
+	retired = g_slist_prepend(retired,old);
+	G_UNLOCK(retired);
+
+	/* Retire from the GTK thread once it is back in the main loop */
+	g_idle_add(retire_snapshots,NULL);
+}
+
+/* 
+ * Borrows the current snapshot. Only for the GTK thread and
+ * only until the current callback returns.
+ */
+Engine *engine_current(void)
+{
+	return (Engine *)g_atomic_pointer_get(&current);
+}
+
+/* Takes a reference to the current snapshot (any thread) */
+Engine *engine_acquire(void)
+{
+	Engine *result = NULL;
+
+	/* Keeps the snapshot from being retired while we take it */
+	G_LOCK(retired);
+	result = (Engine *)g_atomic_pointer_get(&current);
+	if(result != NULL) g_atomic_int_inc(&result->ref_count);
+	G_UNLOCK(retired);
+
+	return result;
+}
+
+/* Drops a reference taken with engine_acquire() */
+void engine_release(Engine *eng)
+{
+	if(eng == NULL) return;
+	if(g_atomic_int_dec_and_test(&eng->ref_count))
+		free_Engine(eng);
+}
+
+/*
+ * Idle callback on the GTK thread. No borrowed pointer from
+ * engine_current() survives past this point.
+ */
+static gboolean retire_snapshots(gpointer data)
+{
+	GSList *old = NULL;
+	GSList *iterator = NULL;
+
+	G_LOCK(retired);
+	old = retired;
+	retired = NULL;
+	for(iterator = old;iterator;iterator = iterator->next)
+	{
+		Engine *eng = iterator->data;
+		/* Drop the reference that came with publishing */
+		if(g_atomic_int_dec_and_test(&eng->ref_count))
+		{
+			g_debug("Retiring engine snapshot %p",eng);
+			free_Engine(eng);
+		}
+	}
+	G_UNLOCK(retired);
+
+	g_slist_free(old);
+	return FALSE; /* Run only once */
+}
+
 /* Print knowledge information (summary of all modapps) */
 void show_knowledge(Engine *eng)
 {
-	int i;
-	int nlines;
+	GSList *iterator = NULL;
 	g_debug("Dumping Knowledge");
 
-	nlines = g_slist_length(eng->knowledge);
-	g_debug("Knowledge has %d entries",nlines);
-	for(i=0 ; i < nlines ; i++)
+	g_debug("Knowledge has %d entries",g_slist_length(eng->knowledge));
+	for(iterator = eng->knowledge;iterator;iterator = iterator->next)
 	{
-		Knowledge *knowbit = (Knowledge *)g_slist_nth_data(eng->knowledge,i);
-		g_message("I have %s/%s/%s",knowbit->type,knowbit->command,knowbit->description);
+		Knowledge *knowbit = (Knowledge *)iterator->data;
+		g_debug("I have %s/%s/%s",knowbit->type,knowbit->command,knowbit->description);
 	}
 }
 
@@ -58,16 +176,28 @@ App *find_application(Engine *eng,gchar *keyword)
 	App *result = NULL;
 	g_debug("Searching for application %s",keyword);
 	result = (App *)g_hash_table_lookup(eng->apps,keyword);
+	if(result != NULL && !result->available) return NULL;
 	return result;
 }
 
-void launch_application(Engine *eng,gchar *keyword)
+/*
+ * Starts an application. It keeps the stdout and stderr of
+ * elevate, since it usually outlives it. Only failures are
+ * shown in the messages box.
+ */
+void launch_application(Engine *eng,gchar *keyword,MessageLog *messages)
 {
 	gboolean success = FALSE;
+	GError *error = NULL;
 	App *found = find_application(eng,keyword);
-	success = g_spawn_command_line_async(found->command,NULL);
+
+	success = g_spawn_command_line_async(found->command,&error);
 	if(success == FALSE)
+	{
 		g_warning("Launching application %s has failed",found->command);
+		messages_append(messages,error->message);
+		g_error_free(error);
+	}
 }
 
 Modapp *find_modapp(Engine *eng,gchar *keyword)
@@ -75,12 +205,104 @@ Modapp *find_modapp(Engine *eng,gchar *keyword)
 	Modapp *result = NULL;
 	g_debug("Searching for module %s",keyword);
 	result = (Modapp *)g_hash_table_lookup(eng->modules,keyword);
+	if(result != NULL && !result->available) return NULL;
+	return result;
+}
+Info *find_information(Engine *eng,gchar *keyword)
+{
+	Info *result = NULL;
+	g_debug("Searching for information %s",keyword);
+	result = (Info *)g_hash_table_lookup(eng->infos,keyword);
 	return result;
 }
+
+gboolean is_info_property(Engine *eng,gchar *keyword)
+{
+	return g_hash_table_lookup(eng->properties,keyword) != NULL;
+}
+
+/*
+ * Answers an information sentence in the messages box.
+ * Returns FALSE if nobody knows.
+ */
+gboolean query_information(Engine *eng,gchar *object,gchar *property,MessageLog *messages)
+{
+	Info *found = NULL;
+
+	if(object != NULL)
+		found = find_information(eng,object);
+	if(found == NULL && property != NULL)
+		found = (Info *)g_hash_table_lookup(eng->properties,property);
+	if(found == NULL)
+	{
+		g_warning("No information about %s",object);
+		return FALSE;
+	}
+	return info_query(found,object,property,messages);
+}
+
 /* Destructor */
 void free_Engine(Engine *eng)
 {
-	//TODO add code here for members of the struct
+	GHashTable *unique = NULL;
+	GList *values = NULL;
+	GList *iterator = NULL;
+
+	free_Weights(eng->weights);
+	if(eng->vocabulary != NULL) free_Vocabulary(eng->vocabulary);
+	if(eng->index != NULL) free_Index(eng->index);
+
+	/* Knowledge entries share their strings with apps and modules */
+	g_slist_foreach(eng->knowledge,free_Knowledge,NULL);
+	g_slist_free(eng->knowledge);
+
+	/* 
+	 * The same App/Modapp is stored once for every keyword
+	 * so we find the distinct ones before freeing them.
+	 */
+	unique = g_hash_table_new(g_direct_hash,g_direct_equal);
+	g_hash_table_foreach(eng->apps,collect_value,unique);
+	g_hash_table_destroy(eng->apps);
+	values = g_hash_table_get_keys(unique);
+	for(iterator = values;iterator;iterator = iterator->next)
+		free_App((App *)iterator->data);
+	g_list_free(values);
+	g_hash_table_remove_all(unique);
+
+	g_hash_table_foreach(eng->modules,collect_value,unique);
+	g_hash_table_destroy(eng->modules);
+	values = g_hash_table_get_keys(unique);
+	for(iterator = values;iterator;iterator = iterator->next)
+		free_Modapp((Modapp *)iterator->data);
+	g_list_free(values);
+	g_hash_table_remove_all(unique);
+
+	g_hash_table_foreach(eng->infos,collect_value,unique);
+	g_hash_table_foreach(eng->properties,collect_value,unique);
+	g_hash_table_destroy(eng->infos);
+	g_hash_table_destroy(eng->properties);
+	values = g_hash_table_get_keys(unique);
+	for(iterator = values;iterator;iterator = iterator->next)
+		free_Info((Info *)iterator->data);
+	g_list_free(values);
+	g_hash_table_destroy(unique);
+
+	/* Only after the infos that point inside them are gone */
+	g_slist_foreach(eng->plugins,(GFunc)g_module_close,NULL);
+	g_slist_free(eng->plugins);
+
 	g_free(eng);
 }
 
+static void collect_value(gpointer key,gpointer value,gpointer unique)
+{
+	g_hash_table_insert((GHashTable *)unique,value,value);
+}
+
+static void free_Knowledge(gpointer data,gpointer unused)
+{
+	Knowledge *knowbit = (Knowledge *)data;
+	g_free(knowbit->type);
+	g_free(knowbit);
+}
+
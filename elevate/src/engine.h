@@ -37,20 +37,37 @@ typedef struct Capabilities
 	GSList *knowledge; /* Holds an array of Knowledge structs */
 	GHashTable *apps;
 	GHashTable *modules;
+	GHashTable *infos; /* Info entries by object keyword */
+	GHashTable *properties; /* Info entries by property keyword */
+	GSList *plugins; /* GModule handles used by the infos */
+	struct scoring_weights *weights; /* How sentences are scored */
+	struct keyword_vocabulary *vocabulary; /* For typos, built after loading */
+	struct capability_index *index; /* Descriptions for "what can ..." */
+	volatile gint ref_count; /* Published snapshot + threads holding it */
 }Engine;
 
 /* Constructor */
 Engine* create_Engine(void);
 
+/* Snapshot handling (see engine.c) */
+void engine_publish(Engine *eng);
+Engine *engine_current(void);
+Engine *engine_acquire(void);
+void engine_release(Engine *eng);
+
 void show_knowledge(Engine *eng);
 
 //TODO see why a simple App does not work here
 struct Application *find_application(Engine *eng,gchar *keyword);
-void launch_application(Engine *eng,gchar *keyword);
+void launch_application(Engine *eng,gchar *keyword,struct message_log *messages);
 
 //TODO again here on struct Module works
 struct Module *find_modapp(Engine *eng,gchar *keyword);
 
+struct Information *find_information(Engine *eng,gchar *keyword);
+gboolean is_info_property(Engine *eng,gchar *keyword);
+gboolean query_information(Engine *eng,gchar *object,gchar *property,MessageLog *messages);
+
 
 /* Destructor */
 void free_Engine(Engine *eng);
@@ -24,20 +24,31 @@
  * directory
  */
 
+#include <time.h>
+
 #include <glib.h>
 #include <glib/gutils.h>
 #include <glib/gstdio.h>
+#include <gmodule.h>
 
+#include "messages.h"
 #include "mod_strings.h"
+#include "elevate_plugin.h"
+#include "info.h"
+#include "score.h"
+#include "fuzzy.h"
 #include "engine.h"
 #include "files.h"
 #include "app.h"
 #include "modapp.h"
+#include "discover.h"
+#include "pathcache.h"
 
 
 
 #define APP_DIR ".elevate"
 #define MOD_DIR "modules"
+#define SCORING_FILE "scoring.conf"
 
 static void load_system_modules(Engine *eng);
 static void load_user_modules(Engine *eng);
@@ -46,7 +57,14 @@ static void load_module(const gchar *filename,Engine *eng);
 
 static void load_mod(GKeyFile *mod_file,Engine *eng);
 static void load_app(GKeyFile *mod_file,Engine *eng);
-static void load_info(GKeyFile *mod_file,Engine *eng);
+static void load_info(GKeyFile *mod_file,Engine *eng,GModule *plugin);
+static void load_plugin(GKeyFile *mod_file,Engine *eng);
+static void load_weights(Engine *eng);
+static gboolean is_installed(const gchar *command,const gchar *keyword);
+
+/* Programs in $PATH, shared by every load */
+static PathCache *programs = NULL;
+G_LOCK_DEFINE_STATIC(programs);
 
 
 
@@ -59,11 +77,30 @@ Engine *create_capabilities(void)
 	result = create_Engine();
 	load_system_modules(result);
 	load_user_modules(result);
+	load_weights(result);
 
+	/* Entries are prepended while loading */
+	result->knowledge = g_slist_reverse(result->knowledge);
+	result->vocabulary = create_Vocabulary(result->apps,result->modules);
+	result->index = create_Index(result);
 	show_knowledge(result);
 
 	return result;
 }
+
+/* Loads only the modules found in path (used by the benchmarks) */
+Engine *create_capabilities_at(const gchar *path)
+{
+	Engine *result = NULL;
+
+	result = create_Engine();
+	load_modules_at(result,path);
+	result->knowledge = g_slist_reverse(result->knowledge);
+	result->vocabulary = create_Vocabulary(result->apps,result->modules);
+	result->index = create_Index(result);
+
+	return result;
+}
 static void load_modules_at(Engine *eng,const gchar *path)
 {
 	GDir *mod_dir = NULL;
@@ -107,7 +144,63 @@ static void load_user_modules(Engine *eng)
 {
 	gchar *mod_dir_path = NULL;
 
+	mod_dir_path = elevate_user_path(MOD_DIR);
+	if(mod_dir_path == NULL) return;
+
+	load_modules_at(eng,mod_dir_path);
+	g_free(mod_dir_path);
+}
+
+/* System weights first, the user can override any of them */
+static void load_weights(Engine *eng)
+{
+	gchar *path = NULL;
+
+	path = g_build_filename(PKGDATADIR,SCORING_FILE,NULL);
+	weights_load(eng->weights,path);
+	g_free(path);
+
+	path = elevate_user_path(SCORING_FILE);
+	if(path != NULL) weights_load(eng->weights,path);
+	g_free(path);
+}
+
+/*
+ * The GUI calls this from time to time. When a $PATH directory
+ * changed the capabilities should be loaded again.
+ */
+gboolean capabilities_outdated(void)
+{
+	gboolean result = FALSE;
+
+	G_LOCK(programs);
+	if(programs != NULL) result = path_cache_refresh(programs);
+	G_UNLOCK(programs);
+	return result;
+}
+
+/* Checks once at load time that the program of a module exists */
+static gboolean is_installed(const gchar *command,const gchar *keyword)
+{
+	gchar *path = NULL;
+
+	G_LOCK(programs);
+	if(programs == NULL) programs = create_PathCache();
+	path = path_cache_resolve(programs,command);
+	G_UNLOCK(programs);
+
+	if(path == NULL)
+	{
+		g_debug("%s is not available, %s is not installed",keyword,command);
+		return FALSE;
+	}
+	g_free(path);
+	return TRUE;
+}
 
+/* Path of a file or directory under ~/.elevate (NULL without a home) */
+gchar *elevate_user_path(const gchar *name)
+{
 	// Find the home directory of the user 
 	const gchar *homedir = g_getenv ("HOME");
 	if (!homedir)
@@ -118,13 +211,9 @@ static void load_user_modules(Engine *eng)
 	if (!homedir)
 	{
 		g_warning("Could not locate your home directory.");
-		return;
+		return NULL;
 	}
-	g_message("Home is at %s",homedir);
-	mod_dir_path = g_build_filename(homedir,APP_DIR,MOD_DIR,NULL);
-
-	load_modules_at(eng,mod_dir_path);
-	g_free(mod_dir_path);
+	return g_build_filename(homedir,APP_DIR,name,NULL);
 }
 
 static void load_module(const gchar *filename,Engine *eng)
@@ -173,6 +262,14 @@ static void load_module(const gchar *filename,Engine *eng)
 	{
 		load_mod(possible,eng);
 	}
+	else if(g_ascii_strcasecmp(type,INF_V) == 0)
+	{
+		load_info(possible,eng,NULL);
+	}
+	else if(g_ascii_strcasecmp(type,PLG_V) == 0)
+	{
+		load_plugin(possible,eng);
+	}
 
 	g_free(type);
 	g_key_file_free(possible);
@@ -224,6 +321,7 @@ static void load_mod(GKeyFile *mod_file,Engine *eng)
 	g_free(temp);
 	//Command
 	mod_app->command = g_key_file_get_string(mod_file,MODAPP_G,COMM_P,NULL);
+	mod_app->available = is_installed(mod_app->command,mod_app->keyword[0]);
 
 	//g_debug("Command %s has %d keywords",mod_app->command,g_strv_length(mod_app->keyword));
 
@@ -286,6 +384,7 @@ static void load_mod(GKeyFile *mod_file,Engine *eng)
 
 		//Default value for this argument
 		arg->default_value = g_key_file_get_string(mod_file,header,DEF_P,NULL);
+		if(arg->default_value != NULL) g_strstrip(arg->default_value);
 
 		//Pattern (%p is the value if any)
 		arg->pattern = g_key_file_get_string(mod_file,header,PAT_P,NULL);
@@ -294,6 +393,7 @@ static void load_mod(GKeyFile *mod_file,Engine *eng)
 		//Add this argument to the rest
 		for(i=0;i<g_strv_length(arg->keyword);i++)
 			g_hash_table_insert(mod_app->arguments,arg->keyword[i],arg);
+		mod_app->order = g_slist_append(mod_app->order,arg);
 
 		g_free(header);
 		arg_n++;
@@ -309,7 +409,7 @@ static void load_mod(GKeyFile *mod_file,Engine *eng)
 	knowbit->type = g_strdup(MOD_V);
 	knowbit->command = mod_app->command;
 	//Add it to the list
-	eng->knowledge = g_slist_append(eng->knowledge,knowbit);
+	eng->knowledge = g_slist_prepend(eng->knowledge,knowbit);
 
 }
 
@@ -336,6 +436,7 @@ static void load_app(GKeyFile *mod_file,Engine *eng)
 	g_free(temp);
 	//Command
 	app->command = g_key_file_get_string(mod_file,APPLICATION_G,COMM_P,NULL);
+	app->available = is_installed(app->command,app->keyword[0]);
 
 	//g_debug("Command %s has %d keywords",app->command,g_strv_length(app->keyword));
 	
@@ -384,11 +485,146 @@ static void load_app(GKeyFile *mod_file,Engine *eng)
 	knowbit->type = g_strdup(APP_V);
 	knowbit->command = app->command;
 	//Add it to the list
-	eng->knowledge = g_slist_append(eng->knowledge,knowbit);
+	eng->knowledge = g_slist_prepend(eng->knowledge,knowbit);
 
 	
 	
 }
-static void load_info(GKeyFile *mod_file,Engine *eng)
+/*
+ * Information modules answer questions such as "show me the free
+ * memory". Each [InfoN] group describes one kind of information with
+ * the objects and properties it knows about.
+ *
+ * If plugin is not NULL the query is answered in-process by the
+ * function named in the symbol property. Otherwise (or if the symbol
+ * is missing) the command is run and its output is shown.
+ */
+static void load_info(GKeyFile *mod_file,Engine *eng,GModule *plugin)
+{
+	Info *info = NULL;
+	gchar *temp = NULL;
+	gchar *description = NULL;
+	Knowledge *knowbit = NULL;
+	int i = 0;
+	int info_n = 0;
+
+	description = g_key_file_get_string(mod_file,GENERAL_G,DESC_P,NULL);
+
+	info_n = 1;
+	while(TRUE)
+	{
+		gchar *header = g_strdup_printf("%s%d",INFO_G,info_n);
+		if(g_key_file_has_group(mod_file,header) == FALSE)
+		{
+			g_free(header);
+			break;
+		}
+
+		info = create_Info();
+		info->description = g_strdup(description);
+		//Objects (1 or more)
+		temp = g_key_file_get_string(mod_file,header,OBJ_P,NULL);
+		if(temp == NULL) temp = g_strdup("");
+		info->object = g_strsplit_set(g_strstrip(temp),SEP " ",-1);
+		g_free(temp);
+		//Properties (0 or more)
+		temp = g_key_file_get_string(mod_file,header,PROP_P,NULL);
+		if(temp == NULL) temp = g_strdup("");
+		info->property = g_strsplit_set(g_strstrip(temp),SEP " ",-1);
+		g_free(temp);
+
+		info->command = g_key_file_get_string(mod_file,header,COMM_P,NULL);
+		info->symbol = g_key_file_get_string(mod_file,header,SYM_P,NULL);
+		if(info->symbol != NULL) g_strstrip(info->symbol);
+
+		//Resolve the fast path
+		if(plugin != NULL && info->symbol != NULL)
+		{
+			gpointer function = NULL;
+			if(g_module_symbol(plugin,info->symbol,&function))
+				info->query = (InfoQuery)function;
+			else
+				g_warning("Plugin %s has no %s",g_module_name(plugin),info->symbol);
+		}
+		if(info->query == NULL && info->command == NULL)
+		{
+			g_warning("%s of %s has neither a symbol nor a command",header,description);
+			free_Info(info);
+			g_free(header);
+			info_n++;
+			continue;
+		}
+
+		//Empty strings come from double separators
+		for(i=0;i<g_strv_length(info->object);i++)
+			if(info->object[i][0] != '\0')
+				g_hash_table_insert(eng->infos,info->object[i],info);
+		for(i=0;i<g_strv_length(info->property);i++)
+			if(info->property[i][0] != '\0')
+				g_hash_table_insert(eng->properties,info->property[i],info);
+
+		//Also create the knowledge entry
+		knowbit = g_new(Knowledge,1);
+		knowbit->description = info->description;
+		knowbit->type = g_strdup(info->query != NULL ? PLG_V : INF_V);
+		knowbit->command = info->query != NULL ? info->symbol : info->command;
+		eng->knowledge = g_slist_prepend(eng->knowledge,knowbit);
+
+		g_free(header);
+		info_n++;
+	}
+	g_free(description);
+}
+
+/*
+ * A plugin module is an information module whose
+ * queries live in a shared object (see elevate_plugin.h)
+ */
+static void load_plugin(GKeyFile *mod_file,Engine *eng)
 {
+	GModule *plugin = NULL;
+	gchar *library = NULL;
+	gchar *path = NULL;
+	gpointer function = NULL;
+
+	library = g_key_file_get_string(mod_file,PLUGIN_G,LIB_P,NULL);
+	if(library == NULL || g_module_supported() == FALSE)
+	{
+		g_warning("Plugin has no library. Using commands only");
+		g_free(library);
+		load_info(mod_file,eng,NULL);
+		return;
+	}
+	g_strstrip(library);
+
+	//Relative names are searched in the system plugin directory
+	if(g_path_is_absolute(library))
+		path = g_strdup(library);
+	else
+		path = g_build_filename(PLUGINDIR,library,NULL);
+	g_free(library);
+
+	plugin = g_module_open(path,G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+	if(plugin == NULL)
+	{
+		g_warning("Could not load plugin %s: %s",path,g_module_error());
+		g_free(path);
+		load_info(mod_file,eng,NULL);
+		return;
+	}
+	//Refuse plugins built against another ABI
+	if(!g_module_symbol(plugin,ELEVATE_PLUGIN_ABI_SYMBOL,&function) ||
+			((InfoAbi)function)() != ELEVATE_PLUGIN_ABI)
+	{
+		g_warning("Plugin %s has the wrong ABI",path);
+		g_module_close(plugin);
+		g_free(path);
+		load_info(mod_file,eng,NULL);
+		return;
+	}
+	g_debug("Loaded plugin %s",path);
+	g_free(path);
+
+	eng->plugins = g_slist_prepend(eng->plugins,plugin);
+	load_info(mod_file,eng,plugin);
 }
@@ -21,5 +21,8 @@
 #define FILES_H
 
 Engine *create_capabilities(void);
+Engine *create_capabilities_at(const gchar *path);
+gchar *elevate_user_path(const gchar *name);
+gboolean capabilities_outdated(void);
 
 #endif
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * A single typo ("firefx") must not lose the sentence. Words that
+ * match nothing are compared with every application and modapp
+ * keyword using Myers' bit-parallel edit distance (one machine word
+ * holds a whole column of the DP matrix, so a comparison costs one
+ * step per character).
+ *
+ * Most keywords never reach that step. Keywords are bucketed by
+ * length and each has a 64 bit signature of its bigrams. Every edit
+ * destroys at most two bigrams of the word, so a keyword that lacks
+ * more than 2*k of the word's bigrams cannot be within k edits.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "app.h"
+#include "modapp.h"
+#include "fuzzy.h"
+
+static void add_keyword(gpointer key,gpointer value,gpointer data);
+static guint64 signature(const gchar *word,guint length);
+static guint allowed_distance(guint length);
+static guint popcount(guint64 bits);
+
+/* Used while building */
+typedef struct vocabulary_builder
+{
+	Vocabulary *vocabulary;
+	KeywordKind kind;
+}Builder;
+
+/* Constructor */
+Vocabulary* create_Vocabulary(GHashTable *apps,GHashTable *modules)
+{
+	Vocabulary *result = NULL;
+	Builder builder;
+	int i;
+
+	result = g_new0(Vocabulary,1);
+	for(i=0;i<=FUZZY_MAX_LENGTH;i++)
+		result->by_length[i] = g_array_new(FALSE,FALSE,sizeof(FuzzyKeyword));
+
+	builder.vocabulary = result;
+	builder.kind = KEYWORD_APPLICATION;
+	g_hash_table_foreach(apps,add_keyword,&builder);
+	builder.kind = KEYWORD_MODAPP;
+	g_hash_table_foreach(modules,add_keyword,&builder);
+
+	g_debug("Fuzzy vocabulary has %d keywords",result->size);
+	return result;
+}
+
+gboolean fuzzy_lookup(const Vocabulary *vocabulary,const gchar *word,FuzzyMatch *match)
+{
+	guint length = strlen(word);
+	guint limit = allowed_distance(length);
+	guint64 wanted = 0;
+	guint best = limit + 1;
+	guint len;
+
+	if(limit == 0 || length > FUZZY_MAX_LENGTH) return FALSE;
+	wanted = signature(word,length);
+
+	for(len = (length > limit) ? length - limit : 1;len <= length + limit && len <= FUZZY_MAX_LENGTH;len++)
+	{
+		GArray *bucket = vocabulary->by_length[len];
+		guint i;
+
+		for(i=0;i<bucket->len;i++)
+		{
+			FuzzyKeyword *candidate = &g_array_index(bucket,FuzzyKeyword,i);
+			guint distance;
+
+			if(popcount(wanted & ~candidate->signature) > 2 * limit) continue;
+
+			distance = edit_distance(word,length,candidate->keyword,len);
+			if(distance < best)
+			{
+				best = distance;
+				match->keyword = candidate->keyword;
+				match->kind = candidate->kind;
+				match->distance = distance;
+			}
+		}
+	}
+	return best <= limit;
+}
+
+/*
+ * Myers (1999) bit-vector algorithm, global variant. Bit i of Pv/Mv
+ * says if D[i][j] - D[i-1][j] is +1/-1. The score follows the last
+ * row, which starts at m.
+ */
+guint edit_distance(const gchar *pattern,guint m,const gchar *text,guint n)
+{
+	guint64 peq[256];
+	guint64 pv = ~(guint64)0;
+	guint64 mv = 0;
+	guint64 high = 0;
+	guint score = m;
+	guint i;
+
+	g_return_val_if_fail(m <= FUZZY_MAX_LENGTH,G_MAXUINT);
+	if(m == 0) return n;
+	if(n == 0) return m;
+	high = (guint64)1 << (m - 1);
+
+	memset(peq,0,sizeof(peq));
+	for(i=0;i<m;i++)
+		peq[(guchar)g_ascii_tolower(pattern[i])] |= (guint64)1 << i;
+
+	for(i=0;i<n;i++)
+	{
+		guint64 eq = peq[(guchar)g_ascii_tolower(text[i])];
+		guint64 xv = eq | mv;
+		guint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+		guint64 ph = mv | ~(xh | pv);
+		guint64 mh = pv & xh;
+
+		if(ph & high) score++;
+		else if(mh & high) score--;
+
+		/* The first row grows by one for every text character */
+		ph = (ph << 1) | 1;
+		mh = mh << 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+	}
+	return score;
+}
+
+/* Destructor */
+void free_Vocabulary(Vocabulary *vocabulary)
+{
+	int i;
+
+	for(i=0;i<=FUZZY_MAX_LENGTH;i++)
+		g_array_free(vocabulary->by_length[i],TRUE);
+	g_free(vocabulary);
+}
+
+static void add_keyword(gpointer key,gpointer value,gpointer data)
+{
+	Builder *builder = (Builder *)data;
+	FuzzyKeyword entry;
+	guint length = strlen((gchar *)key);
+
+	if(length == 0 || length > FUZZY_MAX_LENGTH) return;
+	/* Programs that are not installed are never suggested */
+	if(builder->kind == KEYWORD_APPLICATION && !((App *)value)->available) return;
+	if(builder->kind == KEYWORD_MODAPP && !((Modapp *)value)->available) return;
+
+	entry.keyword = (const gchar *)key;
+	entry.signature = signature(key,length);
+	entry.kind = builder->kind;
+	g_array_append_val(builder->vocabulary->by_length[length],entry);
+	builder->vocabulary->size++;
+}
+
+/* Bigrams including the word boundaries, case insensitive */
+static guint64 signature(const gchar *word,guint length)
+{
+	guint64 result = 0;
+	guchar previous = 0;
+	guint i;
+
+	for(i=0;i<=length;i++)
+	{
+		guchar current = (i < length) ? g_ascii_tolower(word[i]) : 0;
+		guint hash = (previous * 31 + current) & 63;
+
+		result |= (guint64)1 << hash;
+		previous = current;
+	}
+	return result;
+}
+
+/* Short words have too many neighbours to be corrected */
+static guint allowed_distance(guint length)
+{
+	if(length < 4) return 0;
+	if(length < 8) return 1;
+	return 2;
+}
+
+static guint popcount(guint64 bits)
+{
+	guint count = 0;
+
+	while(bits != 0)
+	{
+		bits &= bits - 1;
+		count++;
+	}
+	return count;
+}
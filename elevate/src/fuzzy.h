@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the typo tolerant keyword matching
+ */
+
+#ifndef FUZZY_H
+#define FUZZY_H
+
+/* What a keyword belongs to */
+typedef enum keyword_kind
+{
+	KEYWORD_APPLICATION,
+	KEYWORD_MODAPP
+}KeywordKind;
+
+/* Longest keyword (in bytes) that is matched fuzzily */
+#define FUZZY_MAX_LENGTH 64
+
+typedef struct fuzzy_keyword
+{
+	const gchar *keyword; /* Owned by the App/Modapp */
+	guint64 signature; /* One bit per hashed bigram */
+	KeywordKind kind;
+}FuzzyKeyword;
+
+typedef struct keyword_vocabulary
+{
+	/* Keywords bucketed by length so only close lengths are scanned */
+	GArray *by_length[FUZZY_MAX_LENGTH + 1];
+	guint size;
+}Vocabulary;
+
+typedef struct fuzzy_match
+{
+	const gchar *keyword;
+	KeywordKind kind;
+	guint distance; /* Edit distance from the word typed */
+}FuzzyMatch;
+
+/* Constructor. Indexes every application and modapp keyword */
+Vocabulary* create_Vocabulary(GHashTable *apps,GHashTable *modules);
+
+/* Finds the closest keyword within the allowed distance */
+gboolean fuzzy_lookup(const Vocabulary *vocabulary,const gchar *word,FuzzyMatch *match);
+
+/* Edit distance of two strings, G_MAXUINT if pattern is over 64 bytes */
+guint edit_distance(const gchar *pattern,guint m,const gchar *text,guint n);
+
+/* Destructor */
+void free_Vocabulary(Vocabulary *vocabulary);
+
+
+
+
+#endif
@@ -26,6 +26,12 @@
 
 #define MAX_CMD 35
 
+/* Layout of the messages box (in 0-100 units) */
+#define MESSAGE_TOP 11.5
+#define MESSAGE_LEFT 7
+#define MESSAGE_FONT 2.5
+#define MESSAGE_SPACING 3.2
+
 void draw_fancy_rec(cairo_t *cr,double x0,double y0,double rect_width,double rect_height,double radius)
 {
 	double x1,y1;
@@ -187,14 +193,30 @@ void draw_input_box (cairo_t * cr, const char *command_text,double fx_percent)
 
 }
 
-void draw_messages_box (cairo_t * cr, const char *command_text,int characters_visible)
+/*
+ * Shows the lines of the message log. The caller only passes the
+ * lines that are visible so the cost does not depend on how much
+ * output is kept in the log.
+ */
+void draw_messages_box (cairo_t * cr, const char **lines,int count)
 {
+	int i;
+
 	cairo_save (cr);
 
 	cairo_set_source_rgba (cr, 0, 0, 1.0,0.2);
 	draw_rounded_rect_filled(cr,5,8,90,80,2,0.2);
 
-	show_text_message(cr,5,50,11,command_text,1.0);
+	cairo_select_font_face (cr, "Consolas",
+			CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+	cairo_set_font_size (cr, MESSAGE_FONT);
+	cairo_set_source_rgba (cr, 0, 0, 0, 1.0);
+
+	for(i = 0; i < count && i < MESSAGE_ROWS; i++)
+	{
+		cairo_move_to (cr, MESSAGE_LEFT, MESSAGE_TOP + i * MESSAGE_SPACING);
+		cairo_show_text (cr, lines[i]);
+	}
 
 	cairo_restore(cr);
 
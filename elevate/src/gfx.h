@@ -28,6 +28,9 @@ void show_text_message (cairo_t * cr, int font_size, int pos_x,int pos_y, const
 
 void draw_input_box (cairo_t * cr, const char *command_text,double fx_percent);
 
-void draw_messages_box (cairo_t * cr, const char *command_text,int characters_visible);
+/* Lines that fit in the messages box */
+#define MESSAGE_ROWS 24
+
+void draw_messages_box (cairo_t * cr, const char **lines,int count);
 
 #endif
@@ -0,0 +1,403 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Every command given to elevate is appended to ~/.elevate/history,
+ * one per line. At startup the log is mapped read only and the
+ * entries point straight into the mapping, so even a huge history
+ * costs one pass of memchr() and no copies.
+ *
+ * Reverse search uses a trigram index (trigram -> entry numbers)
+ * built by a worker thread. The rarest trigram of the query gives
+ * the candidates, newest first, which are checked with memmem().
+ * Queries shorter than three characters, or searches before the
+ * index is ready, just scan backwards.
+ *
+ * When most of the log is repeated commands the worker rewrites it
+ * with the last occurrence of every command.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "messages.h"
+#include "history.h"
+
+/* Entries kept when the log is compacted */
+#define HISTORY_MAX 100000
+/* Logs smaller than this are never compacted */
+#define HISTORY_COMPACT 1000
+
+#define TRIGRAM(p) GUINT_TO_POINTER(((guint)(guchar)(p)[0] << 16) | ((guint)(guchar)(p)[1] << 8) | (guchar)(p)[2])
+
+/* Protects entries, trigrams and fd between the GUI and the worker */
+G_LOCK_DEFINE_STATIC(history);
+
+static void read_log(History *history);
+static gpointer history_worker(gpointer data);
+static void index_entry(GHashTable *trigrams,const HistoryEntry *entry,guint number);
+static void compact_log(History *history,const HistoryEntry *snapshot,guint count);
+static gboolean contains(const HistoryEntry *entry,const gchar *query,gsize length);
+static void free_postings(gpointer data);
+
+/* Constructor */
+History* create_History(const gchar *path)
+{
+	History *result = NULL;
+	GError *error = NULL;
+	gchar *dir = NULL;
+
+	result = g_new0(History,1);
+	result->path = g_strdup(path);
+	result->entries = g_array_new(FALSE,FALSE,sizeof(HistoryEntry));
+	result->added = g_string_chunk_new(4096);
+
+	dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir,0700);
+	g_free(dir);
+
+	result->fd = open(path,O_RDWR | O_CREAT | O_APPEND,0600);
+	if(result->fd < 0)
+	{
+		/* Still works for this session */
+		g_warning("Could not open history %s",path);
+		return result;
+	}
+	read_log(result);
+
+	result->worker = g_thread_create(history_worker,result,TRUE,&error);
+	if(result->worker == NULL)
+	{
+		/* Searches scan the entries instead */
+		g_warning("Could not start history thread: %s",error->message);
+		g_error_free(error);
+	}
+	return result;
+}
+
+void history_add(History *history,const gchar *line)
+{
+	HistoryEntry entry;
+	HistoryEntry *last = NULL;
+	gchar *record = NULL;
+	gsize length = strlen(line);
+
+	if(length == 0) return;
+	if(history->entries->len > 0)
+	{
+		last = &g_array_index(history->entries,HistoryEntry,history->entries->len - 1);
+		if(last->length == length && memcmp(last->text,line,length) == 0) return;
+	}
+
+	entry.text = g_string_chunk_insert_len(history->added,line,length);
+	entry.length = length;
+	record = g_strconcat(line,"\n",NULL);
+
+	G_LOCK(history);
+	g_array_append_val(history->entries,entry);
+	if(history->trigrams != NULL)
+		index_entry(history->trigrams,&entry,history->entries->len - 1);
+	if(history->fd >= 0 && write(history->fd,record,length + 1) != (gssize)(length + 1))
+		g_warning("Could not write history %s",history->path);
+	G_UNLOCK(history);
+
+	g_free(record);
+}
+
+guint history_length(History *history)
+{
+	return history->entries->len;
+}
+
+gchar *history_entry(History *history,guint i)
+{
+	HistoryEntry *entry = &g_array_index(history->entries,HistoryEntry,i);
+	return g_strndup(entry->text,entry->length);
+}
+
+gint history_search(History *history,const gchar *query,gint before)
+{
+	gsize length = strlen(query);
+	GArray *best = NULL;
+	gint result = -1;
+	gint low;
+	gint high;
+	gsize i;
+
+	if(length == 0) return -1;
+	if(before > (gint)history->entries->len) before = history->entries->len;
+
+	G_LOCK(history);
+	if(history->trigrams == NULL || length < 3)
+	{
+		for(result = before - 1;result >= 0;result--)
+			if(contains(&g_array_index(history->entries,HistoryEntry,result),query,length)) break;
+		G_UNLOCK(history);
+		return result;
+	}
+
+	/* The rarest trigram gives the fewest candidates */
+	for(i=0;i + 3 <= length;i++)
+	{
+		GArray *postings = g_hash_table_lookup(history->trigrams,TRIGRAM(query + i));
+		if(postings == NULL)
+		{
+			G_UNLOCK(history);
+			return -1;
+		}
+		if(best == NULL || postings->len < best->len) best = postings;
+	}
+
+	/* Last candidate before the starting point */
+	low = 0;
+	high = best->len;
+	while(low < high)
+	{
+		gint middle = (low + high) / 2;
+		if(g_array_index(best,guint,middle) < (guint)before) low = middle + 1;
+		else high = middle;
+	}
+	for(low = low - 1;low >= 0;low--)
+	{
+		guint number = g_array_index(best,guint,low);
+		if(contains(&g_array_index(history->entries,HistoryEntry,number),query,length))
+		{
+			result = number;
+			break;
+		}
+	}
+	G_UNLOCK(history);
+	return result;
+}
+
+/* Destructor */
+void free_History(History *history)
+{
+	if(history->worker != NULL)
+	{
+		g_atomic_int_set(&history->quit,1);
+		g_thread_join(history->worker);
+	}
+	if(history->trigrams != NULL) g_hash_table_destroy(history->trigrams);
+	g_array_free(history->entries,TRUE);
+	g_string_chunk_free(history->added);
+	if(history->map != NULL) munmap(history->map,history->mapped);
+	if(history->fd >= 0) close(history->fd);
+	g_free(history->path);
+	g_free(history);
+}
+
+/* Maps the log and finds the lines */
+static void read_log(History *history)
+{
+	struct stat info;
+	const gchar *line = NULL;
+	const gchar *end = NULL;
+	gpointer map = NULL;
+
+	if(fstat(history->fd,&info) != 0 || info.st_size == 0) return;
+
+	map = mmap(NULL,info.st_size,PROT_READ,MAP_PRIVATE,history->fd,0);
+	if(map == MAP_FAILED)
+	{
+		g_warning("Could not map history %s",history->path);
+		return;
+	}
+	history->map = map;
+	history->mapped = info.st_size;
+
+	end = history->map + history->mapped;
+	for(line = history->map;line < end;)
+	{
+		HistoryEntry entry;
+		const gchar *newline = memchr(line,'\n',end - line);
+
+		if(newline == NULL) newline = end;
+		entry.text = line;
+		entry.length = newline - line;
+		if(entry.length > 0) g_array_append_val(history->entries,entry);
+		line = newline + 1;
+	}
+
+	/* A crash left half a line, start the next one cleanly */
+	if(end[-1] != '\n' && write(history->fd,"\n",1) != 1)
+		g_warning("Could not write history %s",history->path);
+
+	g_debug("History has %d entries",history->entries->len);
+}
+
+static gpointer history_worker(gpointer data)
+{
+	History *history = data;
+	HistoryEntry *snapshot = NULL;
+	GHashTable *trigrams = NULL;
+	GHashTable *seen = NULL;
+	GTimer *timer = NULL;
+	guint count;
+	guint unique = 0;
+	guint i;
+
+	/* The GUI may grow the array while we read it */
+	G_LOCK(history);
+	count = history->entries->len;
+	snapshot = g_memdup(history->entries->data,count * sizeof(HistoryEntry));
+	G_UNLOCK(history);
+
+	timer = g_timer_new();
+	trigrams = g_hash_table_new_full(g_direct_hash,g_direct_equal,NULL,free_postings);
+	for(i=0;i<count;i++)
+	{
+		if(i % 4096 == 0 && g_atomic_int_get(&history->quit))
+		{
+			g_hash_table_destroy(trigrams);
+			goto out;
+		}
+		index_entry(trigrams,&snapshot[i],i);
+	}
+
+	/* Catch up with the entries added meanwhile and publish */
+	G_LOCK(history);
+	for(i=count;i<history->entries->len;i++)
+		index_entry(trigrams,&g_array_index(history->entries,HistoryEntry,i),i);
+	history->trigrams = trigrams;
+	G_UNLOCK(history);
+	g_debug("Indexed %d history entries in %.0f ms",count,g_timer_elapsed(timer,NULL) * 1000);
+
+	/* Is it worth compacting? */
+	if(count < HISTORY_COMPACT) goto out;
+	seen = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,NULL);
+	for(i=0;i<count;i++)
+	{
+		gchar *text = g_strndup(snapshot[i].text,snapshot[i].length);
+		if(g_hash_table_lookup(seen,text) == NULL) unique++;
+		g_hash_table_replace(seen,text,GUINT_TO_POINTER(1));
+	}
+	g_hash_table_destroy(seen);
+	if(unique > count / 2 && count <= HISTORY_MAX) goto out;
+	if(g_atomic_int_get(&history->quit)) goto out;
+
+	compact_log(history,snapshot,count);
+	g_debug("Compacted history from %d to %d entries",count,MIN(unique,HISTORY_MAX));
+
+out:
+	g_timer_destroy(timer);
+	g_free(snapshot);
+	return NULL;
+}
+
+/* Every entry is listed once per trigram, in ascending order */
+static void index_entry(GHashTable *trigrams,const HistoryEntry *entry,guint number)
+{
+	guint i;
+
+	for(i=0;i + 3 <= entry->length;i++)
+	{
+		gpointer key = TRIGRAM(entry->text + i);
+		GArray *postings = g_hash_table_lookup(trigrams,key);
+
+		if(postings == NULL)
+		{
+			postings = g_array_new(FALSE,FALSE,sizeof(guint));
+			g_hash_table_insert(trigrams,key,postings);
+		}
+		else if(g_array_index(postings,guint,postings->len - 1) == number) continue;
+		g_array_append_val(postings,number);
+	}
+}
+
+/*
+ * Rewrites the log with the last occurrence of each command of the
+ * snapshot, followed by whatever was added since. The entries in
+ * memory keep pointing at the old mapping until the next start.
+ */
+static void compact_log(History *history,const HistoryEntry *snapshot,guint count)
+{
+	GHashTable *seen = NULL;
+	GSList *kept = NULL;
+	GSList *iterator = NULL;
+	GString *contents = NULL;
+	GError *error = NULL;
+	guint total = 0;
+	gint i;
+
+	/* Newest first so that the last occurrence wins */
+	seen = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,NULL);
+	for(i=count - 1;i >= 0 && total < HISTORY_MAX;i--)
+	{
+		gchar *text = g_strndup(snapshot[i].text,snapshot[i].length);
+		if(g_hash_table_lookup(seen,text) != NULL)
+		{
+			g_free(text);
+			continue;
+		}
+		g_hash_table_insert(seen,text,GUINT_TO_POINTER(1));
+		kept = g_slist_prepend(kept,(gpointer)&snapshot[i]);
+		total++;
+	}
+	g_hash_table_destroy(seen);
+
+	contents = g_string_new(NULL);
+	for(iterator = kept;iterator;iterator = iterator->next)
+	{
+		const HistoryEntry *entry = iterator->data;
+		g_string_append_len(contents,entry->text,entry->length);
+		g_string_append_c(contents,'\n');
+	}
+	g_slist_free(kept);
+
+	/* Nothing may be appended between the copy and the swap */
+	G_LOCK(history);
+	for(i=count;i < (gint)history->entries->len;i++)
+	{
+		HistoryEntry *entry = &g_array_index(history->entries,HistoryEntry,i);
+		g_string_append_len(contents,entry->text,entry->length);
+		g_string_append_c(contents,'\n');
+	}
+	if(g_file_set_contents(history->path,contents->str,contents->len,&error))
+	{
+		/* Our mapping keeps the old file alive */
+		close(history->fd);
+		history->fd = open(history->path,O_RDWR | O_APPEND,0600);
+	}
+	else
+	{
+		g_warning("Could not compact history: %s",error->message);
+		g_error_free(error);
+	}
+	G_UNLOCK(history);
+
+	g_string_free(contents,TRUE);
+}
+
+static gboolean contains(const HistoryEntry *entry,const gchar *query,gsize length)
+{
+	return memmem(entry->text,entry->length,query,length) != NULL;
+}
+
+static void free_postings(gpointer data)
+{
+	g_array_free((GArray *)data,TRUE);
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the command history
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+typedef struct history_entry
+{
+	const gchar *text; /* Not NUL terminated */
+	guint length;
+}HistoryEntry;
+
+typedef struct command_history
+{
+	gchar *path; /* ~/.elevate/history */
+	gint fd; /* The log, opened for appending */
+
+	/* Entries found at startup point inside the mapped log */
+	gchar *map;
+	gsize mapped;
+
+	GArray *entries; /* HistoryEntry, oldest first */
+	GStringChunk *added; /* Text of the entries of this session */
+	GHashTable *trigrams; /* trigram -> GArray of entry numbers, NULL until built */
+
+	GThread *worker; /* Indexes and compacts the log */
+	volatile gint quit;
+}History;
+
+/* Constructor. Maps the log and starts indexing it */
+History* create_History(const gchar *path);
+
+/* Appends a command to the log (repeats of the last one are ignored) */
+void history_add(History *history,const gchar *line);
+
+/* Number of entries */
+guint history_length(History *history);
+
+/* Copy of entry number i */
+gchar *history_entry(History *history,guint i);
+
+/* Newest entry before entry number before that contains query, or -1 */
+gint history_search(History *history,const gchar *query,gint before);
+
+/* Destructor. Waits for the worker */
+void free_History(History *history);
+
+
+
+
+#endif
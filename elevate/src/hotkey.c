@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * GTK only sees keys pressed in its own windows. A hotkey that
+ * works while elevate is hidden needs XGrabKey on the root window
+ * and a GDK filter that picks the KeyPress before GTK drops it.
+ */
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+
+#include "hotkey.h"
+
+static GdkFilterReturn hotkey_filter(GdkXEvent *xevent,GdkEvent *event,gpointer data);
+static guint x_modifiers(GdkModifierType modifiers);
+
+/* NumLock and CapsLock must not stop the hotkey */
+static const guint lock_masks[] = {0,LockMask,Mod2Mask,LockMask | Mod2Mask};
+#define LOCK_MASKS G_N_ELEMENTS(lock_masks)
+
+/* Constructor */
+Hotkey* create_Hotkey(const gchar *accelerator,HotkeyFunc pressed,gpointer data)
+{
+	Hotkey *result = NULL;
+	Display *display = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+	GdkWindow *root = gdk_get_default_root_window();
+	GdkModifierType modifiers = 0;
+	guint keyval = 0;
+	guint i;
+
+	gtk_accelerator_parse(accelerator,&keyval,&modifiers);
+	if(keyval == 0)
+	{
+		g_warning("Invalid hotkey %s",accelerator);
+		return NULL;
+	}
+
+	result = g_new0(Hotkey,1);
+	result->keycode = XKeysymToKeycode(display,keyval);
+	result->modifiers = x_modifiers(modifiers);
+	result->pressed = pressed;
+	result->data = data;
+
+	/* Another client owning the key shows up as BadAccess */
+	gdk_error_trap_push();
+	for(i=0;i<LOCK_MASKS;i++)
+		XGrabKey(display,result->keycode,result->modifiers | lock_masks[i],
+				GDK_WINDOW_XID(root),False,GrabModeAsync,GrabModeAsync);
+	gdk_flush();
+	if(gdk_error_trap_pop() != 0)
+	{
+		g_warning("Hotkey %s is used by another program",accelerator);
+		for(i=0;i<LOCK_MASKS;i++)
+			XUngrabKey(display,result->keycode,result->modifiers | lock_masks[i],GDK_WINDOW_XID(root));
+		g_free(result);
+		return NULL;
+	}
+
+	gdk_window_add_filter(root,hotkey_filter,result);
+	g_debug("Grabbed hotkey %s",accelerator);
+	return result;
+}
+
+/* Destructor */
+void free_Hotkey(Hotkey *key)
+{
+	Display *display = GDK_DISPLAY_XDISPLAY(gdk_display_get_default());
+	GdkWindow *root = gdk_get_default_root_window();
+	guint i;
+
+	gdk_window_remove_filter(root,hotkey_filter,key);
+	for(i=0;i<LOCK_MASKS;i++)
+		XUngrabKey(display,key->keycode,key->modifiers | lock_masks[i],GDK_WINDOW_XID(root));
+	g_free(key);
+}
+
+static GdkFilterReturn hotkey_filter(GdkXEvent *xevent,GdkEvent *event,gpointer data)
+{
+	Hotkey *key = (Hotkey *)data;
+	XEvent *xev = (XEvent *)xevent;
+	guint state = 0;
+
+	if(xev->type != KeyPress || xev->xkey.keycode != key->keycode)
+		return GDK_FILTER_CONTINUE;
+
+	state = xev->xkey.state & ~(LockMask | Mod2Mask);
+	if(state != key->modifiers) return GDK_FILTER_CONTINUE;
+
+	key->pressed(key->data);
+	return GDK_FILTER_REMOVE;
+}
+
+/* GDK and X share the bits for Shift, Control and Mod1-5 */
+static guint x_modifiers(GdkModifierType modifiers)
+{
+	guint result = modifiers & (ShiftMask | ControlMask | Mod1Mask | Mod3Mask | Mod4Mask | Mod5Mask);
+
+	if(modifiers & GDK_SUPER_MASK) result |= Mod4Mask;
+	return result;
+}
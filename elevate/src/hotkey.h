@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the global hotkey of resident mode
+ */
+
+#ifndef HOTKEY_H
+#define HOTKEY_H
+
+typedef void (*HotkeyFunc)(gpointer data);
+
+typedef struct global_hotkey
+{
+	guint keycode; /* X keycode of the key */
+	guint modifiers; /* X modifier mask */
+	HotkeyFunc pressed;
+	gpointer data;
+}Hotkey;
+
+/* 
+ * Grabs an accelerator such as "<Super>space" on the root window.
+ * Returns NULL if it is invalid or taken by another client.
+ */
+Hotkey* create_Hotkey(const gchar *accelerator,HotkeyFunc pressed,gpointer data);
+
+/* Destructor. Releases the grab */
+void free_Hotkey(Hotkey *key);
+
+
+
+
+#endif
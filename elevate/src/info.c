@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+#include <glib.h>
+
+#include "messages.h"
+#include "elevate_plugin.h"
+#include "info.h"
+
+static gchar *format_value(InfoValue *value);
+
+/* Constructor */
+Info* create_Info(void)
+{
+	Info *result = NULL;
+	result = g_new0(Info,1);
+	return result;
+}
+
+/*
+ * Information is answered in-process if a plugin provides it.
+ * Otherwise we fall back to running the command of the module.
+ * It runs in the background and whatever it prints reaches the
+ * messages box later, so the GTK thread never waits for it.
+ */
+gboolean info_query(Info *info,const gchar *object,const gchar *property,MessageLog *messages)
+{
+	gboolean success = FALSE;
+	gchar **argv = NULL;
+	gint out = -1;
+	gint err = -1;
+	GError *error = NULL;
+
+	if(info->query != NULL)
+	{
+		InfoValue value = {INFO_NONE,0,0.0,NULL,NULL};
+		gchar *answer = NULL;
+
+		g_debug("Asking plugin %s about %s/%s",info->symbol,object,property);
+		if(info->query(object,property,&value)) answer = format_value(&value);
+		else g_free(value.string);
+		if(answer != NULL)
+		{
+			messages_append(messages,answer);
+			g_free(answer);
+			return TRUE;
+		}
+	}
+	if(info->command == NULL) return FALSE;
+
+	g_debug("Running %s for %s",info->command,object);
+	success = g_shell_parse_argv(info->command,NULL,&argv,&error);
+	if(success)
+		success = g_spawn_async_with_pipes(NULL,argv,NULL,G_SPAWN_SEARCH_PATH,
+				NULL,NULL,NULL,NULL,&out,&err,&error);
+	g_strfreev(argv);
+	if(success == FALSE)
+	{
+		g_warning("Information command %s has failed: %s",info->command,error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	messages_watch(messages,out,NULL);
+	messages_watch(messages,err,"!");
+	return TRUE;
+}
+
+static gchar *format_value(InfoValue *value)
+{
+	gchar *result = NULL;
+	const gchar *unit = (value->unit != NULL) ? value->unit : "";
+
+	switch(value->type)
+	{
+		case INFO_INT:
+			result = g_strdup_printf("%" G_GINT64_FORMAT " %s",value->integer,unit);
+			break;
+		case INFO_DOUBLE:
+			result = g_strdup_printf("%.2f %s",value->real,unit);
+			break;
+		case INFO_STRING:
+			result = g_strdup_printf("%s %s",value->string,unit);
+			break;
+		default:
+			break;
+	}
+	g_free(value->string);
+	if(result != NULL) g_strstrip(result);
+	return result;
+}
+
+/* Destructor */
+void free_Info(Info *what)
+{
+	g_free(what->description);
+	g_strfreev(what->object);
+	g_strfreev(what->property);
+	g_free(what->command);
+	g_free(what->symbol);
+	g_free(what);
+}
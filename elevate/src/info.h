@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for an information provider
+ */
+
+#ifndef INFO_H
+#define INFO_H
+
+typedef struct Information
+{
+	gchar *description;
+	gchar **object; /* Things this entry knows about (e.g. memory RAM) */
+	gchar **property; /* Properties of them (e.g. free size left) */
+	gchar *command; /* External command (slow path) */
+	gchar *symbol; /* Query function inside the plugin (fast path) */
+	InfoQuery query; /* Resolved plugin function or NULL */
+}Info;
+
+/* Constructor */
+Info* create_Info(void);
+
+/*
+ * Runs the query. The answer (or the output of the command) goes
+ * to messages. Returns FALSE if nothing could be asked.
+ */
+gboolean info_query(Info *info,const gchar *object,const gchar *property,MessageLog *messages);
+
+/* Destructor */
+void free_Info(Info *what);
+
+
+
+
+#endif
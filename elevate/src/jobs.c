@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Modapps such as cdrecord, compressors or transcoders can run for a
+ * long time and use a lot of CPU and disk. Instead of starting them
+ * right away every pipeline becomes a job. At most max_running jobs
+ * run at the same time and the rest wait in one queue per priority.
+ *
+ * The priority of a job is applied to its processes with nice(2) and
+ * ioprio_set(2) so that background work never slows down the user.
+ * Jobs can be cancelled, suspended (SIGSTOP) and resumed (SIGCONT).
+ *
+ * All jobs are saved in ~/.elevate/jobs after every change so that
+ * queued work survives a restart. Jobs that were running become
+ * interrupted and only run again if the user restarts them.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "messages.h"
+#include "engine.h"
+#include "files.h"
+#include "pipeline.h"
+#include "jobs.h"
+
+#define JOBS_FILE "jobs"
+#define CONFIG_FILE "elevate.conf"
+#define SCHEDULER_G "scheduler"
+#define MAX_JOBS_P "max_jobs"
+#define JOB_G "Job"
+
+/* Finished jobs remembered for the user */
+#define KEEP_FINISHED 20
+
+/* ioprio_set(2) values: class in the top bits, level in the rest */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_VALUE(class,level) (((class) << IOPRIO_CLASS_SHIFT) | (level))
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+static const gint priority_nice[PRIORITY_CLASSES] = {0,5,19};
+static const gint priority_io[PRIORITY_CLASSES] = {
+	IOPRIO_VALUE(IOPRIO_CLASS_BE,0),
+	IOPRIO_VALUE(IOPRIO_CLASS_BE,4),
+	IOPRIO_VALUE(IOPRIO_CLASS_IDLE,0)
+};
+
+static const gchar *state_names[] = {
+	"queued","running","suspended","done","failed","cancelled","interrupted"
+};
+
+static guint read_limit(void);
+static void schedule(Scheduler *sched);
+static void start_job(Scheduler *sched,Job *job);
+static void on_job_finished(Pipeline *pipeline,gpointer data);
+static void forget_old_jobs(Scheduler *sched);
+static void save_jobs(Scheduler *sched);
+static void restore_jobs(Scheduler *sched);
+static gboolean is_finished(Job *job);
+static void free_Job(Job *job);
+
+/* Constructor */
+Scheduler* create_Scheduler(MessageLog *messages)
+{
+	Scheduler *result = NULL;
+	gchar *path = elevate_user_path(JOBS_FILE);
+
+	result = create_Scheduler_at(messages,path);
+	g_free(path);
+	return result;
+}
+
+Scheduler* create_Scheduler_at(MessageLog *messages,const gchar *state_file)
+{
+	Scheduler *result = NULL;
+	int i;
+
+	result = g_new0(Scheduler,1);
+	for(i=0;i<PRIORITY_CLASSES;i++)
+		result->queued[i] = g_queue_new();
+	result->max_running = read_limit();
+	result->next_id = 1;
+	result->messages = messages;
+	result->state_file = g_strdup(state_file);
+
+	restore_jobs(result);
+	schedule(result);
+
+	return result;
+}
+
+Job *scheduler_submit(Scheduler *sched,Pipeline *pipeline,const gchar *sentence,JobPriority priority)
+{
+	Job *job = g_new0(Job,1);
+
+	job->id = sched->next_id++;
+	job->sentence = g_strdup(sentence);
+	job->priority = priority;
+	job->state = JOB_QUEUED;
+	job->pipeline = pipeline;
+	job->scheduler = sched;
+
+	sched->jobs = g_list_append(sched->jobs,job);
+	g_queue_push_tail(sched->queued[priority],job);
+	g_debug("Job %d queued with priority %d",job->id,priority);
+
+	schedule(sched);
+	save_jobs(sched);
+	return job;
+}
+
+Job *scheduler_find(Scheduler *sched,guint id)
+{
+	GList *iterator = NULL;
+
+	for(iterator = sched->jobs;iterator;iterator = iterator->next)
+	{
+		Job *job = iterator->data;
+		if(job->id == id) return job;
+	}
+	return NULL;
+}
+
+gboolean scheduler_cancel(Scheduler *sched,guint id)
+{
+	Job *job = scheduler_find(sched,id);
+
+	if(job == NULL || is_finished(job)) return FALSE;
+
+	if(job->state == JOB_QUEUED || job->state == JOB_INTERRUPTED)
+	{
+		g_queue_remove(sched->queued[job->priority],job);
+		free_Pipeline(job->pipeline);
+		job->pipeline = NULL;
+		job->state = JOB_CANCELLED;
+		save_jobs(sched);
+		return TRUE;
+	}
+
+	/* A stopped process would never see the SIGTERM */
+	if(job->state == JOB_SUSPENDED)
+	{
+		pipeline_signal(job->pipeline,SIGCONT);
+		sched->running++;
+	}
+	job->state = JOB_CANCELLED;
+	pipeline_signal(job->pipeline,SIGTERM);
+	/* The slot is given back when the processes exit */
+	save_jobs(sched);
+	return TRUE;
+}
+
+gboolean scheduler_suspend(Scheduler *sched,guint id)
+{
+	Job *job = scheduler_find(sched,id);
+
+	if(job == NULL || job->state != JOB_RUNNING) return FALSE;
+
+	pipeline_signal(job->pipeline,SIGSTOP);
+	job->state = JOB_SUSPENDED;
+	/* A stopped job uses no CPU or disk, so let another one run */
+	sched->running--;
+	schedule(sched);
+	save_jobs(sched);
+	return TRUE;
+}
+
+gboolean scheduler_resume(Scheduler *sched,guint id)
+{
+	Job *job = scheduler_find(sched,id);
+
+	if(job == NULL || job->state != JOB_SUSPENDED) return FALSE;
+
+	/* This can go over the limit until another job finishes */
+	pipeline_signal(job->pipeline,SIGCONT);
+	job->state = JOB_RUNNING;
+	sched->running++;
+	save_jobs(sched);
+	return TRUE;
+}
+
+gboolean scheduler_restart(Scheduler *sched,guint id)
+{
+	Job *job = scheduler_find(sched,id);
+
+	if(job == NULL || job->state != JOB_INTERRUPTED) return FALSE;
+
+	job->state = JOB_QUEUED;
+	g_queue_push_tail(sched->queued[job->priority],job);
+	schedule(sched);
+	save_jobs(sched);
+	return TRUE;
+}
+
+gboolean scheduler_idle(Scheduler *sched)
+{
+	int i;
+
+	if(sched->running > 0) return FALSE;
+	for(i=0;i<PRIORITY_CLASSES;i++)
+		if(!g_queue_is_empty(sched->queued[i])) return FALSE;
+	return TRUE;
+}
+
+gchar *scheduler_summary(Scheduler *sched)
+{
+	guint queued = 0;
+	guint suspended = 0;
+	GList *iterator = NULL;
+	int i;
+
+	for(i=0;i<PRIORITY_CLASSES;i++)
+		queued += g_queue_get_length(sched->queued[i]);
+	for(iterator = sched->jobs;iterator;iterator = iterator->next)
+		if(((Job *)iterator->data)->state == JOB_SUSPENDED) suspended++;
+
+	if(sched->running == 0 && queued == 0 && suspended == 0)
+		return g_strdup("No jobs");
+	return g_strdup_printf("%d running, %d queued, %d suspended",sched->running,queued,suspended);
+}
+
+void scheduler_list(Scheduler *sched)
+{
+	GList *iterator = NULL;
+
+	if(sched->jobs == NULL)
+	{
+		messages_append(sched->messages,"No jobs");
+		return;
+	}
+	for(iterator = sched->jobs;iterator;iterator = iterator->next)
+	{
+		Job *job = iterator->data;
+		gchar *line = g_strdup_printf("Job %d [%s] %s",job->id,
+				job_state_name(job->state),job->sentence);
+		messages_append(sched->messages,line);
+		g_free(line);
+	}
+}
+
+const gchar *job_state_name(JobState state)
+{
+	if((gint)state < JOB_QUEUED || state > JOB_INTERRUPTED) return "unknown";
+	return state_names[state];
+}
+
+/* Destructor */
+void free_Scheduler(Scheduler *sched)
+{
+	int i;
+
+	save_jobs(sched);
+	for(i=0;i<PRIORITY_CLASSES;i++)
+		g_queue_free(sched->queued[i]);
+	g_list_foreach(sched->jobs,(GFunc)free_Job,NULL);
+	g_list_free(sched->jobs);
+	g_free(sched->state_file);
+	g_free(sched);
+}
+
+/* 
+ * Reads the concurrency limit from ~/.elevate/elevate.conf
+ *
+ * [scheduler]
+ * max_jobs = 2
+ *
+ * The default is one job per processor.
+ */
+static guint read_limit(void)
+{
+	GKeyFile *config = NULL;
+	gchar *path = NULL;
+	gint limit = 0;
+
+	path = elevate_user_path(CONFIG_FILE);
+	config = g_key_file_new();
+	if(path != NULL && g_key_file_load_from_file(config,path,G_KEY_FILE_NONE,NULL))
+		limit = g_key_file_get_integer(config,SCHEDULER_G,MAX_JOBS_P,NULL);
+	g_key_file_free(config);
+	g_free(path);
+
+	if(limit <= 0) limit = sysconf(_SC_NPROCESSORS_ONLN);
+	if(limit <= 0) limit = 1;
+	g_debug("Running at most %d jobs",limit);
+	return limit;
+}
+
+/* Starts queued jobs (highest priority first) while there are free slots */
+static void schedule(Scheduler *sched)
+{
+	int i;
+
+	for(i=0;i<PRIORITY_CLASSES && sched->running < sched->max_running;i++)
+	{
+		while(sched->running < sched->max_running && !g_queue_is_empty(sched->queued[i]))
+			start_job(sched,(Job *)g_queue_pop_head(sched->queued[i]));
+	}
+}
+
+static void start_job(Scheduler *sched,Job *job)
+{
+	GError *error = NULL;
+	gchar *line = NULL;
+
+	job->pipeline->nice = priority_nice[job->priority];
+	job->pipeline->ioprio = priority_io[job->priority];
+	job->pipeline->finished = on_job_finished;
+	job->pipeline->finished_data = job;
+
+	job->state = JOB_RUNNING;
+	sched->running++;
+	if(pipeline_start(job->pipeline,sched->messages,&error) == FALSE)
+	{
+		messages_append(sched->messages,error->message);
+		g_error_free(error);
+		job->state = JOB_FAILED;
+		/* Stages already started still report through on_job_finished */
+		if(job->pipeline->running == 0)
+		{
+			free_Pipeline(job->pipeline);
+			job->pipeline = NULL;
+			sched->running--;
+			schedule(sched);
+		}
+		save_jobs(sched);
+		return;
+	}
+	line = g_strdup_printf("Job %d started: %s",job->id,job->sentence);
+	messages_append(sched->messages,line);
+	g_free(line);
+}
+
+/* Called by the pipeline just before it frees itself */
+static void on_job_finished(Pipeline *pipeline,gpointer data)
+{
+	Job *job = (Job *)data;
+	Scheduler *sched = job->scheduler;
+
+	if(job->state != JOB_SUSPENDED) sched->running--;
+	job->pipeline = NULL;
+	job->status = pipeline->status;
+	if(job->state == JOB_RUNNING || job->state == JOB_SUSPENDED)
+		job->state = (pipeline->status == 0) ? JOB_DONE : JOB_FAILED;
+
+	forget_old_jobs(sched);
+	schedule(sched);
+	save_jobs(sched);
+}
+
+/* Only the last KEEP_FINISHED finished jobs are kept */
+static void forget_old_jobs(Scheduler *sched)
+{
+	guint finished = 0;
+	GList *iterator = NULL;
+
+	for(iterator = sched->jobs;iterator;iterator = iterator->next)
+		if(is_finished(iterator->data)) finished++;
+
+	iterator = sched->jobs;
+	while(iterator != NULL && finished > KEEP_FINISHED)
+	{
+		GList *next = iterator->next;
+		Job *job = iterator->data;
+		if(is_finished(job))
+		{
+			sched->jobs = g_list_delete_link(sched->jobs,iterator);
+			free_Job(job);
+			finished--;
+		}
+		iterator = next;
+	}
+}
+
+static void save_jobs(Scheduler *sched)
+{
+	GKeyFile *state = NULL;
+	GList *iterator = NULL;
+	gchar *data = NULL;
+	gsize length = 0;
+	GError *error = NULL;
+	gchar *dir = NULL;
+
+	if(sched->state_file == NULL) return;
+
+	state = g_key_file_new();
+	for(iterator = sched->jobs;iterator;iterator = iterator->next)
+	{
+		Job *job = iterator->data;
+		gchar *group = g_strdup_printf("%s%d",JOB_G,job->id);
+
+		g_key_file_set_string(state,group,"sentence",job->sentence);
+		g_key_file_set_integer(state,group,"priority",job->priority);
+		g_key_file_set_integer(state,group,"state",job->state);
+		g_key_file_set_integer(state,group,"status",job->status);
+
+		/* Unfinished jobs need everything to be started after a restart */
+		if(job->pipeline != NULL && !is_finished(job))
+		{
+			GSList *stage_it = NULL;
+			GPtrArray *stages = g_ptr_array_new();
+
+			for(stage_it = job->pipeline->stages;stage_it;stage_it = stage_it->next)
+			{
+				Stage *stage = stage_it->data;
+				GString *line = g_string_new(NULL);
+				int i;
+				for(i=0;stage->argv[i] != NULL;i++)
+				{
+					gchar *quoted = g_shell_quote(stage->argv[i]);
+					if(i > 0) g_string_append_c(line,' ');
+					g_string_append(line,quoted);
+					g_free(quoted);
+				}
+				g_ptr_array_add(stages,g_string_free(line,FALSE));
+			}
+			g_key_file_set_string_list(state,group,"stages",
+					(const gchar * const *)stages->pdata,stages->len);
+			g_ptr_array_foreach(stages,(GFunc)g_free,NULL);
+			g_ptr_array_free(stages,TRUE);
+
+			if(job->pipeline->input != NULL)
+				g_key_file_set_string(state,group,"input",job->pipeline->input);
+			if(job->pipeline->output != NULL)
+				g_key_file_set_string(state,group,"output",job->pipeline->output);
+		}
+		g_free(group);
+	}
+
+	data = g_key_file_to_data(state,&length,NULL);
+	dir = g_path_get_dirname(sched->state_file);
+	g_mkdir_with_parents(dir,0700);
+	g_free(dir);
+	if(!g_file_set_contents(sched->state_file,data,length,&error))
+	{
+		g_warning("Could not save jobs: %s",error->message);
+		g_error_free(error);
+	}
+	g_free(data);
+	g_key_file_free(state);
+}
+
+/*
+ * Queued jobs are queued again. Jobs that were running or suspended
+ * when elevate went away are marked as interrupted. Running them
+ * again could be wrong (e.g. a half written CD) so the user decides
+ * with scheduler_restart(). Entries with a state we do not know (a
+ * corrupt or edited file) are dropped.
+ */
+static void restore_jobs(Scheduler *sched)
+{
+	GKeyFile *state = NULL;
+	gchar **groups = NULL;
+	int i;
+
+	if(sched->state_file == NULL) return;
+
+	state = g_key_file_new();
+	if(!g_key_file_load_from_file(state,sched->state_file,G_KEY_FILE_NONE,NULL))
+	{
+		g_key_file_free(state);
+		return;
+	}
+
+	groups = g_key_file_get_groups(state,NULL);
+	for(i=0;groups[i] != NULL;i++)
+	{
+		Job *job = NULL;
+		gint saved = 0;
+
+		if(!g_str_has_prefix(groups[i],JOB_G)) continue;
+
+		saved = g_key_file_get_integer(state,groups[i],"state",NULL);
+		if(saved < JOB_QUEUED || saved > JOB_INTERRUPTED)
+		{
+			g_warning("Job %s has an unknown state %d",groups[i],saved);
+			continue;
+		}
+
+		job = g_new0(Job,1);
+		job->id = g_ascii_strtoull(groups[i] + strlen(JOB_G),NULL,10);
+		job->sentence = g_key_file_get_string(state,groups[i],"sentence",NULL);
+		job->priority = CLAMP(g_key_file_get_integer(state,groups[i],"priority",NULL),0,PRIORITY_CLASSES - 1);
+		job->state = saved;
+		job->status = g_key_file_get_integer(state,groups[i],"status",NULL);
+		job->scheduler = sched;
+		if(job->sentence == NULL) job->sentence = g_strdup("");
+		if(job->id >= sched->next_id) sched->next_id = job->id + 1;
+
+		if(job->state == JOB_RUNNING || job->state == JOB_SUSPENDED)
+		{
+			gchar *line = g_strdup_printf("Job %d was interrupted, \"restart %d\" runs it again: %s",
+					job->id,job->id,job->sentence);
+			messages_append(sched->messages,line);
+			g_free(line);
+			job->state = JOB_INTERRUPTED;
+		}
+
+		if(job->state == JOB_QUEUED || job->state == JOB_INTERRUPTED)
+		{
+			gchar **stages = NULL;
+			int j;
+
+			job->pipeline = create_Pipeline();
+			job->pipeline->input = g_key_file_get_string(state,groups[i],"input",NULL);
+			job->pipeline->output = g_key_file_get_string(state,groups[i],"output",NULL);
+			stages = g_key_file_get_string_list(state,groups[i],"stages",NULL,NULL);
+			for(j=0;stages != NULL && stages[j] != NULL;j++)
+			{
+				gchar **argv = NULL;
+				if(g_shell_parse_argv(stages[j],NULL,&argv,NULL))
+					pipeline_add_stage(job->pipeline,argv);
+			}
+			g_strfreev(stages);
+
+			if(job->pipeline->stages == NULL)
+			{
+				free_Pipeline(job->pipeline);
+				job->pipeline = NULL;
+				job->state = JOB_FAILED;
+			}
+			else if(job->state == JOB_QUEUED)
+			{
+				g_queue_push_tail(sched->queued[job->priority],job);
+			}
+		}
+		sched->jobs = g_list_append(sched->jobs,job);
+	}
+	g_strfreev(groups);
+	g_key_file_free(state);
+}
+
+/* Interrupted jobs wait for the user */
+static gboolean is_finished(Job *job)
+{
+	return job->state >= JOB_DONE && job->state != JOB_INTERRUPTED;
+}
+
+static void free_Job(Job *job)
+{
+	/* Pipelines of running jobs free themselves */
+	if((job->state == JOB_QUEUED || job->state == JOB_INTERRUPTED) && job->pipeline != NULL)
+		free_Pipeline(job->pipeline);
+	g_free(job->sentence);
+	g_free(job);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the scheduler of long-running modapp jobs
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+typedef enum job_state
+{
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_SUSPENDED,
+	JOB_DONE,
+	JOB_FAILED,
+	JOB_CANCELLED,
+	JOB_INTERRUPTED /* Was running when an older elevate exited, see scheduler_restart */
+}JobState;
+
+typedef enum job_priority
+{
+	PRIORITY_INTERACTIVE,
+	PRIORITY_NORMAL,
+	PRIORITY_BACKGROUND
+}JobPriority;
+
+#define PRIORITY_CLASSES 3
+
+typedef struct scheduled_job
+{
+	guint id;
+	gchar *sentence; /* What the user typed */
+	JobPriority priority;
+	JobState state;
+	gint status; /* Exit status once finished */
+	struct process_pipeline *pipeline; /* NULL once finished (interrupted jobs keep theirs) */
+	struct job_scheduler *scheduler;
+}Job;
+
+typedef struct job_scheduler
+{
+	GList *jobs; /* All known jobs, oldest first */
+	GQueue *queued[PRIORITY_CLASSES]; /* Waiting jobs per priority */
+	guint running; /* Jobs using a slot (suspended ones do not) */
+	guint max_running; /* Concurrency limit */
+	guint next_id;
+	gchar *state_file; /* Where jobs survive restarts, NULL for nowhere */
+	struct message_log *messages;
+}Scheduler;
+
+/* Constructor. Reads the limit and the saved jobs */
+Scheduler* create_Scheduler(struct message_log *messages);
+/* Jobs are kept in state_file instead, NULL keeps them in memory only */
+Scheduler* create_Scheduler_at(struct message_log *messages,const gchar *state_file);
+
+/* Queues a pipeline. The scheduler takes it */
+Job *scheduler_submit(Scheduler *sched,struct process_pipeline *pipeline,const gchar *sentence,JobPriority priority);
+
+Job *scheduler_find(Scheduler *sched,guint id);
+gboolean scheduler_cancel(Scheduler *sched,guint id);
+gboolean scheduler_suspend(Scheduler *sched,guint id);
+gboolean scheduler_resume(Scheduler *sched,guint id);
+/* Queues an interrupted job again. It starts from the beginning */
+gboolean scheduler_restart(Scheduler *sched,guint id);
+
+/* TRUE when nothing runs or waits */
+gboolean scheduler_idle(Scheduler *sched);
+
+/* Short summary for the status box (e.g. "2 running, 1 queued") */
+gchar *scheduler_summary(Scheduler *sched);
+
+/* Writes one line per job to the message log */
+void scheduler_list(Scheduler *sched);
+
+const gchar *job_state_name(JobState state);
+
+/* Destructor */
+void free_Scheduler(Scheduler *sched);
+
+
+
+
+#endif
@@ -17,19 +17,32 @@
  *
  * Project Elevate - Core 
  */
+#include <string.h>
 #include <glib.h>
 
+#include "messages.h"
 #include "app.h"
 #include "modapp.h"
+#include "elevate_plugin.h"
+#include "info.h"
 #include "engine.h"
+#include "jobs.h"
+#include "score.h"
+#include "fuzzy.h"
 #include "lang.h"
 
 static void feed(Language *lang,gchar *word);
+static void count_token(Language *lang,TokenClass token);
+static gboolean correct(Language *lang,gchar *word);
+static void score(Language *lang,gchar **tokens,int start,int end);
+static gboolean is_pipe_word(gchar *word);
+static gint priority_word(gchar *word);
 static gboolean is_application(gchar *word,Engine *eng);
 static gboolean is_launch_verb(gchar *word);
 static gboolean is_open_verb(gchar *word);
 static gboolean is_object(gchar *word);
 static gboolean is_modapp(gchar *word,Engine *eng);
+static gboolean is_info(gchar *word,Engine *eng);
 
 /* Constructor */
 Language* create_Language(Engine *eng)
@@ -37,17 +50,20 @@ Language* create_Language(Engine *eng)
 	Language *result = NULL;
 	result = g_new(Language,1);
 	result->eng = eng;
-	result->sen = g_new(Sentence,1);
+	result->sen = g_new0(Sentence,1);
 	result->sen->type = -1;
+	result->sen->priority = PRIORITY_NORMAL;
+	result->current = result->sen;
 
 
 	return result;
 }
 /*
  * There are several kind of sentences that can be parsed.
- * Each keyword adds points to a specific kind of sentence.
- * When parsing is finished the sentence with the highest points
- * is assumed to be the correct.
+ * Each keyword is counted in its token class and the counts
+ * are weighted for every kind of sentence (see score.c).
+ * When parsing is finished the best interpretations are kept
+ * with their confidence, best first.
  * 
  * Kinds of sentences
  * 
@@ -61,86 +77,149 @@ Language* create_Language(Engine *eng)
  * We need to be able to understand the difference between
  * show lala.pdf (sentence 3 runs xpdf lala.pdf) with
  * show the headers of lala.pdf (sentence 4 runs pdfinfo lala.pdf)
+ *
+ * Several sentences can be chained into a pipeline with "then"
+ * or "|" (compress lala.pdf then encrypt). Each part is scored
+ * on its own and becomes one stage in the sen->next list.
+ *
+ * Words like "later" or "now" set the priority of the job
+ * (burn lala.iso later).
  */
 void process(Language *lang,gchar *input)
 {
 	gchar** tokens = NULL;
 	int i =0;
-	int greatest = -1;
-	int winner = -1;
+	int start = 0;
+	int length = 0;
 
 	//Get all words
 	tokens = g_strsplit(input," ",-1);
-	g_debug("Found %d tokens",g_strv_length(tokens));
-
-	/* 
-	 * For each kind of possible sentence
-	 * we keep a single counter.
-	 */
-	for(i=0;i<6;i++) lang->points[i] = 0;
+	length = g_strv_length(tokens);
+	g_debug("Found %d tokens",length);
 
-	for(i=0;i<g_strv_length(tokens);i++)
+	for(i=0;i<length;i++)
 	{
 		g_strstrip(tokens[i]);
-		feed(lang,tokens[i]);
-	}
+		if(is_pipe_word(tokens[i]) == FALSE) continue;
 
-	//Find the sentence with largest score
-	for(i =0;i<6;i++)
-	{
-		if(lang->points[i] >= greatest) 
-		{
-			greatest = lang->points[i];
-			winner = i;
-		}
+		//End of a stage
+		score(lang,tokens,start,i);
+		lang->current->next = g_new0(Sentence,1);
+		lang->current = lang->current->next;
+		lang->current->type = -1;
+		start = i + 1;
 	}
-	if(greatest ==0) return; //No sentence
-
-	lang->sen->type = winner;
+	score(lang,tokens,start,length);
 
 	g_strfreev(tokens);
 
 }
 
+/* Scores tokens [start,end) as the current sentence */
+static void score(Language *lang,gchar **tokens,int start,int end)
+{
+	int i =0;
+	Sentence *sen = lang->current;
+
+	memset(lang->features,0,sizeof(lang->features));
+	for(i=start;i<end;i++)
+		feed(lang,tokens[i]);
+
+	sen->ranked = score_sentence(lang->eng->weights,lang->features,sen->candidates,SCORE_TOP);
+	if(sen->ranked == 0) return; //No sentence
+
+	sen->type = sen->candidates[0].type;
+	sen->confidence = sen->candidates[0].confidence;
+}
+
+/* Counts a word without overflowing the compact vector */
+static void count_token(Language *lang,TokenClass token)
+{
+	if(lang->features[token] < G_MAXUINT8) lang->features[token]++;
+}
+
+static gboolean is_pipe_word(gchar *word)
+{
+	if(g_ascii_strcasecmp(word,"then") == 0) return TRUE;
+	if(g_ascii_strcasecmp(word,"|") == 0) return TRUE;
+	return FALSE;
+}
+
+/* Returns the JobPriority a word asks for or -1 */
+static gint priority_word(gchar *word)
+{
+	if(g_ascii_strcasecmp(word,"now") == 0) return PRIORITY_INTERACTIVE;
+	if(g_ascii_strcasecmp(word,"urgently") == 0) return PRIORITY_INTERACTIVE;
+	if(g_ascii_strcasecmp(word,"later") == 0) return PRIORITY_BACKGROUND;
+	if(g_ascii_strcasecmp(word,"background") == 0) return PRIORITY_BACKGROUND;
+	return -1;
+}
 
 /* Destructor */
 void free_Language(Language *lang)
 {
-	//TODO add code here for members of the struct
+	Sentence *sen = lang->sen;
+
+	while(sen != NULL)
+	{
+		Sentence *next = sen->next;
+		g_free(sen->verb);
+		g_free(sen->object);
+		g_free(sen->tags);
+		g_free(sen->infoObject);
+		g_free(sen->infoProperty);
+		g_free(sen->application);
+		g_free(sen->module);
+		g_free(sen->command);
+		g_free(sen->corrected);
+		g_free(sen);
+		sen = next;
+	}
 	g_free(lang);
 }
 
 static void feed(Language *lang,gchar *word)
 {
+	gint priority = priority_word(word);
+	gboolean known = FALSE;
+
+	//Check for a priority keyword
+	if(priority >= 0)
+	{
+		g_debug("Job priority is %d",priority);
+		lang->sen->priority = priority;
+		return;
+	}
 	//Check for an application
 	if(is_application(word,lang->eng))
 	{
 		g_debug("We have an application: %s ",word);
-		lang->points[0]++;
-		lang->points[1]++;
-		lang->sen->application = g_strdup(word); //FIXME memory leak
+		count_token(lang,TOKEN_APPLICATION);
+		g_free(lang->current->application);
+		lang->current->application = g_strdup(word);
 		return;
 	}
 	//Check for launch keyword
 	if(is_launch_verb(word))
 	{
 		g_debug("We have a launch verb!");
-		lang->points[1]++;
-		lang->points[2]++;
+		count_token(lang,TOKEN_LAUNCH_VERB);
+		known = TRUE;
 	}
 	//Check for open keyword
 	if(is_open_verb(word))
 	{
 		g_debug("We have an open verb!");
-		lang->points[2]++;
+		count_token(lang,TOKEN_OPEN_VERB);
+		known = TRUE;
 	}
 	//Check for object
 	if(is_object(word))
 	{
 		g_debug("We have an object: %s ",word);
-		lang->points[2]++;
-		lang->points[3]++;
-		lang->sen->object = g_strdup(word); //FIXME memory leak
+		count_token(lang,TOKEN_OBJECT);
+		g_free(lang->current->object);
+		lang->current->object = g_strdup(word);
 
 		return;
 	}
@@ -148,13 +227,64 @@ static void feed(Language *lang,gchar *word)
 	if(is_modapp(word,lang->eng))
 	{
 		g_debug("We have a module: %s ",word);
-		lang->points[3]++;
-		lang->sen->module = g_strdup(word); //FIXME memory leak
+		count_token(lang,TOKEN_MODAPP);
+		g_free(lang->current->module);
+		lang->current->module = g_strdup(word);
+		return;
+	}
+	//Check for information object
+	if(is_info(word,lang->eng))
+	{
+		g_debug("We have an information object: %s ",word);
+		count_token(lang,TOKEN_INFO_OBJECT);
+		g_free(lang->current->infoObject);
+		lang->current->infoObject = g_strdup(word);
+		return;
+	}
+	//Check for information property
+	if(is_info_property(lang->eng,word))
+	{
+		g_debug("We have an information property: %s ",word);
+		count_token(lang,TOKEN_INFO_PROPERTY);
+		g_free(lang->current->infoProperty);
+		lang->current->infoProperty = g_strdup(word);
 		return;
 	}
 
+	if(known) return;
 
+	//Maybe a keyword with a typo
+	if(correct(lang,word)) return;
+	count_token(lang,TOKEN_UNKNOWN);
+}
 
+/*
+ * Replaces a misspelled application or modapp keyword with the
+ * closest one. It is counted as a weaker token.
+ */
+static gboolean correct(Language *lang,gchar *word)
+{
+	FuzzyMatch match;
+
+	if(lang->eng->vocabulary == NULL) return FALSE;
+	if(!fuzzy_lookup(lang->eng->vocabulary,word,&match)) return FALSE;
+
+	g_debug("%s could be %s (distance %d)",word,match.keyword,match.distance);
+	g_free(lang->current->corrected);
+	lang->current->corrected = g_strdup(word);
+	if(match.kind == KEYWORD_APPLICATION)
+	{
+		count_token(lang,TOKEN_FUZZY_APPLICATION);
+		g_free(lang->current->application);
+		lang->current->application = g_strdup(match.keyword);
+	}
+	else
+	{
+		count_token(lang,TOKEN_FUZZY_MODAPP);
+		g_free(lang->current->module);
+		lang->current->module = g_strdup(match.keyword);
+	}
+	return TRUE;
 }	
 static gboolean is_application(gchar *word,Engine *eng)
 {
@@ -229,4 +359,9 @@ static gboolean is_modapp(gchar *word,Engine *eng)
 	if(modapp != NULL) return TRUE;
 	else return FALSE;
 }
-
+static gboolean is_info(gchar *word,Engine *eng)
+{
+	Info *info = find_information(eng,word);
+	if(info != NULL) return TRUE;
+	else return FALSE;
+}
@@ -35,14 +35,21 @@ typedef struct complete_sentence
 	gchar *application;
 	gchar *module;
 	gchar *command;
-	gint type;
+	gchar *corrected; /* Misspelled word that was replaced or NULL */
+	gint type; /* Best interpretation or -1 */
+	gfloat confidence; /* Of the best interpretation */
+	Candidate candidates[SCORE_TOP]; /* Best first */
+	guint ranked; /* Valid candidates */
+	gint priority; /* JobPriority of the whole pipeline */
+	struct complete_sentence *next; /* Next stage of a pipeline or NULL */
 }Sentence;
 
 typedef struct language_grammar
 {
 	Engine *eng;
-	Sentence *sen;
-	gint points[6];
+	Sentence *sen; /* First (or only) stage */
+	Sentence *current; /* Stage being fed */
+	guint8 features[TOKEN_CLASSES]; /* Words of each class in the current stage */
 }Language;
 
 /* Constructor */
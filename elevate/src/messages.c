@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * The message log keeps the output of commands in a ring buffer of
+ * fixed size. A command that prints megabytes only overwrites old
+ * lines, so memory use never grows. Output arrives through
+ * non-blocking GIOChannel watches and each watch reads a bounded
+ * amount per dispatch so that frames are never delayed.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "messages.h"
+
+/* Bytes read from a child in one go before giving frames a chance */
+#define READ_BUDGET 65536
+#define READ_CHUNK 4096
+
+typedef struct message_watch
+{
+	MessageLog *log;
+	GString *partial; /* Line not terminated yet */
+	gchar *tag;
+}Watch;
+
+static void append_line(MessageLog *log,const gchar *tag,const gchar *line,gsize length);
+static void append_split(MessageLog *log,const gchar *line,gsize length);
+static gboolean on_child_output(GIOChannel *source,GIOCondition condition,gpointer data);
+static void flush_partial(Watch *watch);
+
+/* Constructor */
+MessageLog* create_MessageLog(void)
+{
+	MessageLog *result = NULL;
+	result = g_new0(MessageLog,1);
+	return result;
+}
+
+void messages_append(MessageLog *log,const gchar *text)
+{
+	const gchar *start = text;
+	const gchar *end = NULL;
+
+	if(text == NULL) return;
+	while((end = strchr(start,'\n')) != NULL)
+	{
+		append_split(log,start,end - start);
+		start = end + 1;
+	}
+	if(*start != '\0') append_split(log,start,strlen(start));
+}
+
+/*
+ * Lock-free since only one thread produces and only the
+ * GTK thread consumes. The slot is filled before tail is
+ * published so the consumer never sees a half written entry.
+ */
+gboolean messages_post(MessageLog *log,const gchar *text)
+{
+	gint tail = g_atomic_int_get(&log->tail);
+	gint next = (tail + 1) % MESSAGES_QUEUE;
+
+	if(next == g_atomic_int_get(&log->head))
+	{
+		g_atomic_int_inc(&log->dropped);
+		return FALSE;
+	}
+	log->queue[tail] = g_strdup(text);
+	g_atomic_int_set(&log->tail,next);
+	return TRUE;
+}
+
+void messages_drain(MessageLog *log)
+{
+	gint head = g_atomic_int_get(&log->head);
+	gint tail = g_atomic_int_get(&log->tail);
+	gint dropped = 0;
+
+	while(head != tail)
+	{
+		messages_append(log,log->queue[head]);
+		g_free(log->queue[head]);
+		log->queue[head] = NULL;
+		head = (head + 1) % MESSAGES_QUEUE;
+		g_atomic_int_set(&log->head,head);
+	}
+
+	dropped = g_atomic_int_get(&log->dropped);
+	if(dropped > 0)
+	{
+		gchar *notice = g_strdup_printf("(%d lines lost)",dropped);
+		g_atomic_int_add(&log->dropped,-dropped);
+		messages_append(log,notice);
+		g_free(notice);
+	}
+}
+
+void messages_watch(MessageLog *log,gint fd,const gchar *tag)
+{
+	GIOChannel *channel = NULL;
+	Watch *watch = NULL;
+
+	channel = g_io_channel_unix_new(fd);
+	g_io_channel_set_encoding(channel,NULL,NULL); /* Raw bytes */
+	g_io_channel_set_flags(channel,G_IO_FLAG_NONBLOCK,NULL);
+	g_io_channel_set_close_on_unref(channel,TRUE);
+
+	watch = g_new0(Watch,1);
+	watch->log = log;
+	watch->partial = g_string_sized_new(MESSAGES_LINE_MAX);
+	watch->tag = g_strdup(tag);
+
+	log->watches++;
+	g_io_add_watch(channel,G_IO_IN | G_IO_HUP | G_IO_ERR,on_child_output,watch);
+	g_io_channel_unref(channel); /* The watch keeps it alive */
+}
+
+gboolean messages_idle(MessageLog *log)
+{
+	return log->watches == 0 && g_atomic_int_get(&log->head) == g_atomic_int_get(&log->tail);
+}
+
+guint messages_window(MessageLog *log,const gchar **lines,guint rows)
+{
+	guint shown = 0;
+	guint last = 0;
+	guint i = 0;
+
+	if(log->count == 0) return 0;
+
+	/* The newest visible line and how many fit above it */
+	last = log->count - 1 - MIN(log->scroll,log->count - 1);
+	shown = MIN(rows,last + 1);
+	for(i = 0;i < shown;i++)
+	{
+		guint index = (log->first + last + 1 - shown + i) % MESSAGES_CAPACITY;
+		lines[i] = log->lines[index];
+	}
+	return shown;
+}
+
+void messages_scroll(MessageLog *log,gint delta)
+{
+	gint scroll = (gint)log->scroll + delta;
+
+	if(scroll < 0) scroll = 0;
+	if(log->count > 0 && scroll > (gint)log->count - 1) scroll = log->count - 1;
+	log->scroll = scroll;
+}
+
+/* Destructor */
+void free_MessageLog(MessageLog *log)
+{
+	messages_drain(log);
+	g_free(log);
+}
+
+/* Copies a line into the ring, overwriting the oldest one when full */
+static void append_line(MessageLog *log,const gchar *tag,const gchar *line,gsize length)
+{
+	guint slot = 0;
+	gchar *target = NULL;
+
+	if(log->count < MESSAGES_CAPACITY)
+	{
+		slot = (log->first + log->count) % MESSAGES_CAPACITY;
+		log->count++;
+	}
+	else
+	{
+		slot = log->first;
+		log->first = (log->first + 1) % MESSAGES_CAPACITY;
+	}
+	target = log->lines[slot];
+	if(tag != NULL)
+		g_snprintf(target,MESSAGES_LINE_MAX,"%s %.*s",tag,(int)length,line);
+	else
+		g_snprintf(target,MESSAGES_LINE_MAX,"%.*s",(int)length,line);
+	if(log->echo) g_printerr("%s\n",target);
+
+	/* Keep the view still if the user has scrolled back */
+	if(log->scroll > 0 && log->scroll < log->count - 1) log->scroll++;
+}
+
+/* A line too long for one slot goes into several */
+static void append_split(MessageLog *log,const gchar *line,gsize length)
+{
+	do
+	{
+		gsize part = MIN(length,MESSAGES_LINE_MAX - 1);
+		append_line(log,NULL,line,part);
+		line += part;
+		length -= part;
+	}
+	while(length > 0);
+}
+
+static void flush_partial(Watch *watch)
+{
+	if(watch->partial->len == 0) return;
+	append_line(watch->log,watch->tag,watch->partial->str,watch->partial->len);
+	g_string_truncate(watch->partial,0);
+}
+
+static gboolean on_child_output(GIOChannel *source,GIOCondition condition,gpointer data)
+{
+	Watch *watch = (Watch *)data;
+	gchar buffer[READ_CHUNK];
+	gsize budget = READ_BUDGET;
+	GIOStatus status = G_IO_STATUS_NORMAL;
+
+	while(budget > 0)
+	{
+		gsize got = 0;
+		gsize i = 0;
+
+		status = g_io_channel_read_chars(source,buffer,READ_CHUNK,&got,NULL);
+		if(status != G_IO_STATUS_NORMAL) break;
+
+		for(i = 0;i < got;i++)
+		{
+			if(buffer[i] == '\n')
+			{
+				flush_partial(watch);
+				continue;
+			}
+			g_string_append_c(watch->partial,buffer[i]);
+			if(watch->partial->len >= MESSAGES_LINE_MAX - 1)
+				flush_partial(watch);
+		}
+		budget -= MIN(budget,got);
+	}
+
+	/* More to read later or still open */
+	if(status == G_IO_STATUS_NORMAL || status == G_IO_STATUS_AGAIN)
+		return TRUE;
+
+	/* The child has closed its end */
+	flush_partial(watch);
+	watch->log->watches--;
+	g_string_free(watch->partial,TRUE);
+	g_free(watch->tag);
+	g_free(watch);
+	return FALSE;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the message log shown in the messages box
+ */
+
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+/* Lines kept in memory. Older lines are overwritten */
+#define MESSAGES_CAPACITY 1024
+/* Longer lines are split */
+#define MESSAGES_LINE_MAX 128
+/* Lines that a worker thread can post before the GUI drains them */
+#define MESSAGES_QUEUE 256
+
+typedef struct message_log
+{
+	/* Ring buffer. Only touched by the GTK thread */
+	gchar lines[MESSAGES_CAPACITY][MESSAGES_LINE_MAX];
+	guint first; /* Oldest line */
+	guint count; /* Lines in use */
+	guint scroll; /* How many lines we are looking back from the newest */
+	gboolean echo; /* Also print every line to stderr (batch mode) */
+	guint watches; /* Children whose output is still being read */
+
+	/* Single producer/single consumer queue for a worker thread */
+	gchar *queue[MESSAGES_QUEUE];
+	volatile gint head; /* Next slot to drain. Moved by the GTK thread */
+	volatile gint tail; /* Next slot to fill. Moved by the producer */
+	volatile gint dropped; /* Lines lost because the queue was full */
+}MessageLog;
+
+/* Constructor */
+MessageLog* create_MessageLog(void);
+
+/* Adds text (one or more lines). GTK thread only */
+void messages_append(MessageLog *log,const gchar *text);
+
+/* Adds a line from a worker thread (the module loader). Only one producer is allowed */
+gboolean messages_post(MessageLog *log,const gchar *text);
+
+/* Moves posted lines into the log. Called by the GTK thread every frame */
+void messages_drain(MessageLog *log);
+
+/* Shows everything a child writes on fd. Lines are prefixed with tag */
+void messages_watch(MessageLog *log,gint fd,const gchar *tag);
+
+/* TRUE when no child output or posted line is pending */
+gboolean messages_idle(MessageLog *log);
+
+/* Fills lines with at most rows pointers to the visible lines */
+guint messages_window(MessageLog *log,const gchar **lines,guint rows);
+
+/* Scrolls back (positive) or forward (negative) */
+void messages_scroll(MessageLog *log,gint delta);
+
+/* Destructor */
+void free_MessageLog(MessageLog *log);
+
+
+
+
+#endif
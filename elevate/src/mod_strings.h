@@ -33,6 +33,8 @@
 #define FILETYPES_G "filetypes"
 #define MODAPP_G "modapp"
 #define ARG_G "Argument"
+#define INFO_G "Info"
+#define PLUGIN_G "plugin"
 
 /* Part 2 - Properties */
 
@@ -56,6 +58,14 @@
 #define DEF_P "default"
 #define PAT_P "pattern"
 
+/* properties for the info sections */
+#define OBJ_P "object"
+#define PROP_P "property"
+#define SYM_P "symbol"
+
+/* properties for the plugin section */
+#define LIB_P "library"
+
 /* Part 3 - VALUES */
 
 /* Separator for multiple value */
@@ -65,6 +75,7 @@
 #define MOD_V "module"
 #define APP_V "application"
 #define INF_V "information"
+#define PLG_V "plugin"
 
 /* Values for accepts */
 #define SIN_V "single"
@@ -21,18 +21,23 @@
 
 #include "modapp.h"
 
+static void collect_arg(gpointer key,gpointer value,gpointer unique);
+
 /* Constructor */
 Arg* create_Arg(void)
 {
 	Arg *result = NULL;
-	result = g_new(Arg,1);
+	result = g_new0(Arg,1);
 	return result;
 }
 
 /* Destructor */
 void free_Arg(Arg *what)
 {
-	//TODO add code here for members of the struct
+	g_free(what->description);
+	g_strfreev(what->keyword);
+	g_free(what->default_value);
+	g_free(what->pattern);
 	g_free(what);
 }
 
@@ -41,15 +46,93 @@ void free_Arg(Arg *what)
 Modapp* create_Modapp(void)
 {
 	Modapp *result = NULL;
-	result = g_new(Modapp,1);
+	result = g_new0(Modapp,1);
 	result->arguments = g_hash_table_new(g_str_hash,g_str_equal); 
 	return result;
 }
 
+/*
+ * Builds the command line of a module from the patterns of its
+ * arguments. Implied arguments are always present. A parameter
+ * without a default value takes the object of the sentence. When
+ * there is no object (e.g. a middle stage of a pipeline) that
+ * argument is left out and the tool works on stdin/stdout.
+ */
+gchar **modapp_command(Modapp *what,const gchar *object)
+{
+	GString *line = NULL;
+	GSList *iterator = NULL;
+	gchar **argv = NULL;
+	GError *error = NULL;
+
+	line = g_string_new(what->command);
+	for(iterator = what->order;iterator;iterator = iterator->next)
+	{
+		Arg *arg = iterator->data;
+		gchar *value = NULL;
+		gchar **parts = NULL;
+		gchar *expanded = NULL;
+
+		if(arg->implied == FALSE || arg->pattern == NULL) continue;
+
+		if(arg->parameter)
+		{
+			if(arg->default_value != NULL)
+				value = g_shell_quote(arg->default_value);
+			else if(object != NULL)
+				value = g_shell_quote(object);
+			else
+				continue;
+		}
+		else
+		{
+			value = g_strdup("");
+		}
+
+		/* Replace every %p in the pattern */
+		parts = g_strsplit(arg->pattern,"%p",-1);
+		expanded = g_strjoinv(value,parts);
+		g_string_append_printf(line," %s",expanded);
+		g_free(expanded);
+		g_strfreev(parts);
+		g_free(value);
+	}
+
+	if(!g_shell_parse_argv(line->str,NULL,&argv,&error))
+	{
+		g_warning("Bad command line %s: %s",line->str,error->message);
+		g_error_free(error);
+		argv = NULL;
+	}
+	g_string_free(line,TRUE);
+	return argv;
+}
+
 /* Destructor */
 void free_Modapp(Modapp *what)
 {
-	//TODO add code here for members of the struct
+	GHashTable *unique = NULL;
+	GList *values = NULL;
+	GList *iterator = NULL;
+
+	/* Arguments are also stored once per keyword */
+	unique = g_hash_table_new(g_direct_hash,g_direct_equal);
+	g_hash_table_foreach(what->arguments,collect_arg,unique);
+	g_hash_table_destroy(what->arguments);
+	values = g_hash_table_get_keys(unique);
+	for(iterator = values;iterator;iterator = iterator->next)
+		free_Arg((Arg *)iterator->data);
+	g_list_free(values);
+	g_hash_table_destroy(unique);
+	g_slist_free(what->order);
+
+	g_free(what->description);
+	g_strfreev(what->keyword);
+	g_free(what->command);
 	g_free(what);
 }
 
+static void collect_arg(gpointer key,gpointer value,gpointer unique)
+{
+	g_hash_table_insert((GHashTable *)unique,value,value);
+}
@@ -41,8 +41,10 @@ typedef struct Module
 	gchar *description;
 	gchar **keyword;
 	gchar *command;
+	gboolean available; /* The command is installed */
 
 	GHashTable *arguments;
+	GSList *order; /* Arguments as they appear in the module file */
 
 }Modapp;
 
@@ -55,6 +57,9 @@ void free_Arg(Arg *what);
 /* Constructor */
 Modapp* create_Modapp(void);
 
+/* Command line for running the module on object (which can be NULL) */
+gchar **modapp_command(Modapp *what,const gchar *object);
+
 /* Destructor */
 void free_Modapp(Modapp *what);
 
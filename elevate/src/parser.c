@@ -17,11 +17,29 @@
  *
  * Project Elevate - Core 
  */
+#include <string.h>
+
 #include <glib.h>
 
+#include "messages.h"
+#include "app.h"
+#include "modapp.h"
 #include "engine.h"
+#include "jobs.h"
 #include "parser.h"
+#include "score.h"
 #include "lang.h"
+#include "pipeline.h"
+#include "discover.h"
+
+static gboolean control_jobs(gchar *input,Scheduler *sched,MessageLog *messages);
+static gboolean discover(gchar *input,Engine *eng,MessageLog *messages);
+static void describe_pipeline(Pipeline *pipeline,MessageLog *messages);
+static void suggest(Sentence *sen,MessageLog *messages);
+static void run_modules(Engine *eng,Sentence *sen,const gchar *input,Scheduler *sched,MessageLog *messages);
+
+/* Describe commands instead of running them */
+static gboolean dry_run = FALSE;
 
 
 
@@ -34,31 +52,75 @@ Parser* create_Parser(void)
 	return result;
 }
 
-void start_parsing(gchar *input,Engine *eng)
+void start_parsing(gchar *input,Engine *eng,Scheduler *sched,MessageLog *messages)
 {
-	int i=0;
 	Language *lang = NULL;
-	int type;
 	
 	g_debug("Got %s",input);
+	if(dispatch_input(input,eng,sched,messages) != INPUT_SENTENCE) return;
+
+	lang = parse_sentence(input,eng);
+	run_sentence(lang,input,sched,messages);
+	free_Language(lang);
+}
+
+InputKind dispatch_input(gchar *input,Engine *eng,Scheduler *sched,MessageLog *messages)
+{
+	if(control_jobs(input,sched,messages)) return INPUT_JOBS;
+	if(discover(input,eng,messages)) return INPUT_QUESTION;
+	return INPUT_SENTENCE;
+}
+
+Language *parse_sentence(gchar *input,Engine *eng)
+{
+	int i=0;
+	Language *lang = NULL;
+
 	lang= create_Language(eng);
 	process(lang,input);
 
-	//Finished processing print table
-	for(i=0;i<6;i++)
-		g_debug("Sentence %d got %d",i,lang->points[i]);
+	//Finished processing print the candidates
+	for(i=0;i<lang->sen->ranked;i++)
+		g_debug("Sentence %s got %.2f (%.0f%%)",
+				sentence_type_name(lang->sen->candidates[i].type),
+				lang->sen->candidates[i].score,
+				lang->sen->candidates[i].confidence * 100);
+
+	return lang;
+}
+
+void run_sentence(Language *lang,const gchar *input,Scheduler *sched,MessageLog *messages)
+{
+	Engine *eng = lang->eng;
+	int type;
+	gchar *line = NULL;
 
 	//Interpret sentence
 	type = lang->sen->type;
 	g_debug("Type is %d",type);
 
+	/* Rather ask than launch the wrong thing */
+	if(type >= 0 && lang->sen->confidence < eng->weights->min_confidence)
+	{
+		suggest(lang->sen,messages);
+		return;
+	}
+
 	switch(type)
 	{
 		case 0:
 		case 1:
 			//capable.launchApplication(complete.getApplication());
 			g_debug("Launching application: %s",lang->sen->application);
-			launch_application(eng,lang->sen->application);
+			if(dry_run)
+			{
+				App *app = find_application(eng,lang->sen->application);
+				line = g_strdup_printf("Would launch %s",app ? app->command : lang->sen->application);
+				messages_append(messages,line);
+				g_free(line);
+				break;
+			}
+			launch_application(eng,lang->sen->application,messages);
 			break;
 		case 2:
 			//capable.openObject(complete.getObject());
@@ -68,19 +130,233 @@ void start_parsing(gchar *input,Engine *eng)
 			//output.append("Using module "+complete.getModule());
 			g_debug("Module is %s",lang->sen->module);
 			g_debug("Object is %s",lang->sen->object);
+			run_modules(eng,lang->sen,input,sched,messages);
 			break;
 		case 4:
 			g_debug("Using vault...");
 			break;
 		case 5:
 			g_debug("Information mode...");
+			if(dry_run)
+			{
+				line = g_strdup_printf("Would query %s of %s",lang->sen->infoProperty,lang->sen->infoObject);
+				messages_append(messages,line);
+				g_free(line);
+				break;
+			}
+			if(!query_information(eng,lang->sen->infoObject,lang->sen->infoProperty,messages))
+				messages_append(messages,"No information about that");
 			break;
 		default:
 			g_debug(">>>>>>>>>>>>Could not understand sentence<<<<<<<");
+			messages_append(messages,"Could not understand sentence");
 			break;
 
 	}
+}
+
+void parser_set_dry_run(gboolean enabled)
+{
+	dry_run = enabled;
+}
+
+/*
+ * Sentences that manage jobs instead of the language:
+ * "jobs", "cancel 3", "pause 3", "resume 3" and "restart 3"
+ */
+static gboolean control_jobs(gchar *input,Scheduler *sched,MessageLog *messages)
+{
+	gchar **words = NULL;
+	gboolean success = FALSE;
+	guint id = 0;
+
+	words = g_strsplit(g_strstrip(input)," ",-1);
+	if(g_strv_length(words) == 1 && g_ascii_strcasecmp(words[0],"jobs") == 0)
+	{
+		if(dry_run) messages_append(messages,"Would list the jobs");
+		else scheduler_list(sched);
+		g_strfreev(words);
+		return TRUE;
+	}
+	if(g_strv_length(words) != 2 ||
+			(g_ascii_strcasecmp(words[0],"cancel") != 0 &&
+			 g_ascii_strcasecmp(words[0],"pause") != 0 &&
+			 g_ascii_strcasecmp(words[0],"resume") != 0 &&
+			 g_ascii_strcasecmp(words[0],"restart") != 0))
+	{
+		g_strfreev(words);
+		return FALSE;
+	}
+
+	id = g_ascii_strtoull(words[1],NULL,10);
+	if(dry_run)
+	{
+		gchar *line = g_strdup_printf("Would %s job %u",words[0],id);
+		messages_append(messages,line);
+		g_free(line);
+		g_strfreev(words);
+		return TRUE;
+	}
+
+	if(g_ascii_strcasecmp(words[0],"cancel") == 0)
+		success = scheduler_cancel(sched,id);
+	else if(g_ascii_strcasecmp(words[0],"pause") == 0)
+		success = scheduler_suspend(sched,id);
+	else if(g_ascii_strcasecmp(words[0],"resume") == 0)
+		success = scheduler_resume(sched,id);
+	else
+		success = scheduler_restart(sched,id);
+
+	if(!success)
+		messages_append(messages,"No such job in that state");
+	g_strfreev(words);
+	return TRUE;
+}
+
+/*
+ * Runs a module sentence. A single module gets the object as
+ * an argument. In a pipeline the object of the first stage is
+ * fed to its stdin and the object of the last stage receives
+ * the output. The pipeline becomes a job.
+ */
+static void run_modules(Engine *eng,Sentence *sen,const gchar *input,Scheduler *sched,MessageLog *messages)
+{
+	Pipeline *pipeline = NULL;
+	Sentence *stage = NULL;
+	gboolean single = (sen->next == NULL);
+
+	pipeline = create_Pipeline();
+	for(stage = sen;stage;stage = stage->next)
+	{
+		Modapp *mod = NULL;
+		gchar **argv = NULL;
+
+		if(stage->module != NULL) mod = find_modapp(eng,stage->module);
+		if(mod == NULL)
+		{
+			messages_append(messages,"Every part of a pipeline must be a module");
+			free_Pipeline(pipeline);
+			return;
+		}
+		argv = modapp_command(mod,single ? stage->object : NULL);
+		if(argv == NULL)
+		{
+			gchar *line = g_strdup_printf("Module %s has a bad command line",stage->module);
+			messages_append(messages,line);
+			g_free(line);
+			free_Pipeline(pipeline);
+			return;
+		}
+		pipeline_add_stage(pipeline,argv);
+
+		if(single) continue;
+		if(stage == sen && stage->object != NULL)
+			pipeline->input = g_strdup(stage->object);
+		else if(stage->next == NULL && stage->object != NULL)
+			pipeline->output = g_strdup(stage->object);
+	}
+
+	/* The last stage writes data, not text for the messages box */
+	if(!single && pipeline->output == NULL)
+	{
+		messages_append(messages,"Name a file for the output (compress a.txt then encrypt a.gz.gpg)");
+		free_Pipeline(pipeline);
+		return;
+	}
+
+	if(dry_run)
+	{
+		describe_pipeline(pipeline,messages);
+		free_Pipeline(pipeline);
+		return;
+	}
+	scheduler_submit(sched,pipeline,input,sen->priority);
+}
+
+/*
+ * Questions about capabilities (what can burn a cd, help compress)
+ * are answered from the description index instead of being run.
+ */
+static gboolean discover(gchar *input,Engine *eng,MessageLog *messages)
+{
+	static const gchar *questions[] = {"what can ","help ","how do i ",NULL};
+	Hit hits[DISCOVER_RESULTS];
+	GTimer *timer = NULL;
+	guint found;
+	guint i;
+
+	if(eng->index == NULL) return FALSE;
+	if(g_ascii_strcasecmp(input,"help") == 0)
+	{
+		messages_append(messages,"Ask \"what can ...\", \"how do i ...\" or \"help <word>\"");
+		return TRUE;
+	}
+	for(i=0;questions[i] != NULL;i++)
+		if(g_ascii_strncasecmp(input,questions[i],strlen(questions[i])) == 0) break;
+	if(questions[i] == NULL) return FALSE;
+
+	timer = g_timer_new();
+	found = index_search(eng->index,input,hits,DISCOVER_RESULTS);
+	g_debug("Searched %d capabilities in %.0f us",eng->index->docs->len,
+			g_timer_elapsed(timer,NULL) * 1000000);
+	g_timer_destroy(timer);
+
+	if(found == 0)
+	{
+		messages_append(messages,"No module knows how to do that");
+		return TRUE;
+	}
+	for(i=0;i<found;i++)
+	{
+		gchar *line = g_strdup_printf("%s (%s): %s",hits[i].capability->name,
+				hits[i].capability->kind,hits[i].capability->description ? hits[i].capability->description : "");
+		messages_append(messages,line);
+		g_free(line);
+	}
+	return TRUE;
+}
+
+/* Lists the interpretations of an unclear sentence */
+static void suggest(Sentence *sen,MessageLog *messages)
+{
+	GString *line = g_string_new("Not sure what you mean. Could be:");
+	guint i;
+
+	for(i=0;i<sen->ranked;i++)
+		g_string_append_printf(line," %s (%.0f%%)",
+				sentence_type_name(sen->candidates[i].type),
+				sen->candidates[i].confidence * 100);
+	if(sen->corrected != NULL)
+		g_string_append_printf(line,". Did you mean %s instead of %s?",
+				sen->module ? sen->module : sen->application,sen->corrected);
+	messages_append(messages,line->str);
+	g_string_free(line,TRUE);
+}
+
+/* Writes the shell equivalent of a pipeline */
+static void describe_pipeline(Pipeline *pipeline,MessageLog *messages)
+{
+	GString *line = g_string_new("Would run");
+	GSList *iterator = NULL;
+
+	for(iterator = pipeline->stages;iterator;iterator = iterator->next)
+	{
+		Stage *stage = iterator->data;
+		int i;
+
+		if(iterator != pipeline->stages) g_string_append(line," |");
+		for(i=0;stage->argv[i] != NULL;i++)
+		{
+			gchar *quoted = g_shell_quote(stage->argv[i]);
+			g_string_append_printf(line," %s",quoted);
+			g_free(quoted);
+		}
+	}
+	if(pipeline->input != NULL) g_string_append_printf(line," < %s",pipeline->input);
+	if(pipeline->output != NULL) g_string_append_printf(line," > %s",pipeline->output);
 
+	messages_append(messages,line->str);
+	g_string_free(line,TRUE);
 }
 
 /* Destructor */
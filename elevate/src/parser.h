@@ -35,7 +35,28 @@ typedef struct command_parser
 /* Constructor */
 Parser* create_Parser(void);
 
-void start_parsing(gchar *input,Engine *eng);
+/* What start_parsing found in the input */
+typedef enum input_kind
+{
+	INPUT_SENTENCE, /* Parsed by the language engine */
+	INPUT_JOBS, /* jobs, cancel 3, pause 3, resume 3, restart 3 */
+	INPUT_QUESTION /* what can, help, how do i */
+}InputKind;
+
+void start_parsing(gchar *input,Engine *eng,struct job_scheduler *sched,struct message_log *messages);
+
+/*
+ * First step of start_parsing. Handles job control and capability
+ * questions, returns INPUT_SENTENCE for everything else.
+ */
+InputKind dispatch_input(gchar *input,Engine *eng,struct job_scheduler *sched,struct message_log *messages);
+
+/* The other two steps (timed separately in batch mode) */
+struct language_grammar *parse_sentence(gchar *input,Engine *eng);
+void run_sentence(struct language_grammar *lang,const gchar *input,struct job_scheduler *sched,struct message_log *messages);
+
+/* Commands are described in the messages instead of being run */
+void parser_set_dry_run(gboolean enabled);
 
 /* Destructor */
 void free_Parser(Parser *par);
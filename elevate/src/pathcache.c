@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Modules wrap programs like cdrecord or xpdf that may not be
+ * installed. Instead of asking the filesystem for every module
+ * (g_find_program_in_path tries each $PATH directory) the names in
+ * each directory are listed once. A directory is only listed again
+ * when its modification time changes.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "messages.h"
+#include "pathcache.h"
+
+static void scan_directory(PathDirectory *dir,time_t mtime);
+static gboolean is_program(const gchar *path);
+static void free_PathDirectory(gpointer data);
+
+/* Constructor */
+PathCache* create_PathCache(void)
+{
+	PathCache *result = NULL;
+	gchar **paths = NULL;
+	int i;
+
+	result = g_new0(PathCache,1);
+	result->directories = g_ptr_array_new();
+
+	paths = g_strsplit(g_getenv("PATH") ? g_getenv("PATH") : "/usr/bin:/bin",G_SEARCHPATH_SEPARATOR_S,-1);
+	for(i=0;paths[i] != NULL;i++)
+	{
+		PathDirectory *dir = NULL;
+
+		if(paths[i][0] == '\0') continue; //Empty means the current directory, skip it
+		dir = g_new0(PathDirectory,1);
+		dir->path = g_strdup(paths[i]);
+		dir->programs = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,NULL);
+		g_ptr_array_add(result->directories,dir);
+	}
+	g_strfreev(paths);
+
+	path_cache_refresh(result);
+	return result;
+}
+
+gchar *path_cache_resolve(PathCache *cache,const gchar *command)
+{
+	gchar **argv = NULL;
+	gchar *result = NULL;
+	guint i;
+
+	if(command == NULL) return NULL;
+	if(!g_shell_parse_argv(command,NULL,&argv,NULL)) return NULL;
+
+	if(strchr(argv[0],'/') != NULL)
+	{
+		if(is_program(argv[0])) result = g_strdup(argv[0]);
+		g_strfreev(argv);
+		return result;
+	}
+
+	for(i=0;i<cache->directories->len && result == NULL;i++)
+	{
+		PathDirectory *dir = g_ptr_array_index(cache->directories,i);
+		gchar *path = NULL;
+
+		if(g_hash_table_lookup(dir->programs,argv[0]) == NULL) continue;
+		path = g_build_filename(dir->path,argv[0],NULL);
+		if(is_program(path)) result = path;
+		else g_free(path);
+	}
+	g_strfreev(argv);
+	return result;
+}
+
+gboolean path_cache_refresh(PathCache *cache)
+{
+	gboolean changed = FALSE;
+	guint i;
+
+	for(i=0;i<cache->directories->len;i++)
+	{
+		PathDirectory *dir = g_ptr_array_index(cache->directories,i);
+		struct stat info;
+		time_t mtime = 0;
+
+		if(stat(dir->path,&info) == 0) mtime = info.st_mtime;
+
+		/*
+		 * A change in the same second as the listing could be
+		 * missed by the mtime, so such directories are listed again.
+		 */
+		if(mtime == dir->mtime && dir->mtime < dir->scanned) continue;
+
+		scan_directory(dir,mtime);
+		changed = TRUE;
+	}
+	return changed;
+}
+
+/* Destructor */
+void free_PathCache(PathCache *cache)
+{
+	guint i;
+
+	for(i=0;i<cache->directories->len;i++)
+		free_PathDirectory(g_ptr_array_index(cache->directories,i));
+	g_ptr_array_free(cache->directories,TRUE);
+	g_free(cache);
+}
+
+static void scan_directory(PathDirectory *dir,time_t mtime)
+{
+	GDir *listing = NULL;
+	const gchar *name = NULL;
+
+	g_hash_table_remove_all(dir->programs);
+	dir->mtime = mtime;
+	dir->scanned = time(NULL);
+
+	/* Directories that do not exist are just empty */
+	listing = g_dir_open(dir->path,0,NULL);
+	if(listing == NULL) return;
+
+	while((name = g_dir_read_name(listing)) != NULL)
+		g_hash_table_insert(dir->programs,g_strdup(name),GINT_TO_POINTER(TRUE));
+	g_dir_close(listing);
+
+	g_debug("Found %d programs in %s",g_hash_table_size(dir->programs),dir->path);
+}
+
+static gboolean is_program(const gchar *path)
+{
+	return g_file_test(path,G_FILE_TEST_IS_EXECUTABLE) && !g_file_test(path,G_FILE_TEST_IS_DIR);
+}
+
+static void free_PathDirectory(gpointer data)
+{
+	PathDirectory *dir = data;
+
+	g_hash_table_destroy(dir->programs);
+	g_free(dir->path);
+	g_free(dir);
+}
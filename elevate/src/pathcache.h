@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the cache of the programs found in $PATH
+ */
+
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+typedef struct path_directory
+{
+	gchar *path;
+	time_t mtime; /* When the directory was last changed */
+	time_t scanned; /* When we listed it */
+	GHashTable *programs; /* Names found in it */
+}PathDirectory;
+
+typedef struct path_cache
+{
+	GPtrArray *directories; /* PathDirectory in $PATH order */
+}PathCache;
+
+/* Constructor. Lists every directory of $PATH */
+PathCache* create_PathCache(void);
+
+/* Full path of the program a command line runs, NULL if not installed */
+gchar *path_cache_resolve(PathCache *cache,const gchar *command);
+
+/* Lists again the directories that changed. TRUE if any did */
+gboolean path_cache_refresh(PathCache *cache);
+
+/* Destructor */
+void free_PathCache(PathCache *cache);
+
+
+
+
+#endif
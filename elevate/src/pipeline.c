@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Runs several modapps as one job. Stages are connected with
+ * pipes and run concurrently, so the data of one tool flows
+ * straight into the next one through the kernel. Elevate never
+ * reads the bytes in between.
+ *
+ * If the last stage should end up in a file, elevate moves its
+ * output with splice(2) from the pipeline to the file. This keeps the
+ * data inside the kernel while still letting us count how much was
+ * written. Only a single modapp prints into the message log. The
+ * output of a pipeline is data (compress x then encrypt) so it always
+ * needs a file, and without one it is discarded.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <glib.h>
+
+#include "messages.h"
+#include "pipeline.h"
+
+/* Bytes spliced in one dispatch before giving frames a chance */
+#define SPLICE_CHUNK (1024 * 1024)
+#define SPLICE_BUDGET (8 * SPLICE_CHUNK)
+
+/* What a stage sees as stdin/stdout. Used in the child only */
+typedef struct stage_fds
+{
+	gint in;
+	gint out;
+	gint nice;
+	gint ioprio;
+}StageFds;
+
+/* From linux/ioprio.h which is not always installed */
+#define IOPRIO_WHO_PROCESS 1
+
+typedef struct output_sink
+{
+	Pipeline *pipeline;
+	gint from; /* Read end of the pipeline from the last stage */
+	gint to; /* Output file */
+	gboolean spliced; /* FALSE once splice failed and we copy */
+}Sink;
+
+static void setup_stage(gpointer data);
+static void report_setup(const gchar *message);
+static void on_stage_exit(GPid pid,gint status,gpointer data);
+static gboolean on_output(GIOChannel *source,GIOCondition condition,gpointer data);
+static gboolean move_output(Sink *sink);
+static void finish_stage(Pipeline *pipeline);
+
+/* Constructor */
+Pipeline* create_Pipeline(void)
+{
+	Pipeline *result = NULL;
+	result = g_new0(Pipeline,1);
+	return result;
+}
+
+void pipeline_add_stage(Pipeline *pipeline,gchar **argv)
+{
+	Stage *stage = g_new0(Stage,1);
+
+	stage->argv = argv;
+	stage->name = g_strdup_printf("[%s]",argv[0]);
+	pipeline->stages = g_slist_append(pipeline->stages,stage);
+}
+
+gboolean pipeline_start(Pipeline *pipeline,MessageLog *messages,GError **error)
+{
+	GSList *iterator = NULL;
+	gint previous = -1; /* Read end that feeds the next stage */
+	gint target = -1; /* Output file */
+	gint flags = G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_CHILD_INHERITS_STDIN;
+
+	pipeline->messages = messages;
+
+	if(pipeline->output == NULL && g_slist_length(pipeline->stages) > 1)
+	{
+		messages_append(messages,"No file for the output of the pipeline, it is discarded");
+		pipeline->output = g_strdup("/dev/null");
+	}
+	if(pipeline->output != NULL)
+	{
+		target = open(pipeline->output,O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+		if(target < 0)
+		{
+			g_set_error(error,g_quark_from_static_string("pipeline"),errno,
+					"Could not create %s: %s",pipeline->output,g_strerror(errno));
+			return FALSE;
+		}
+	}
+
+	/* The first stage reads the input file directly */
+	if(pipeline->input != NULL)
+	{
+		previous = open(pipeline->input,O_RDONLY | O_CLOEXEC);
+		if(previous < 0)
+		{
+			g_set_error(error,g_quark_from_static_string("pipeline"),errno,
+					"Could not open %s: %s",pipeline->input,g_strerror(errno));
+			if(target >= 0) close(target);
+			return FALSE;
+		}
+	}
+	else
+	{
+		previous = open("/dev/null",O_RDONLY | O_CLOEXEC);
+	}
+
+	for(iterator = pipeline->stages;iterator;iterator = iterator->next)
+	{
+		Stage *stage = iterator->data;
+		StageFds fds;
+		gint link[2];
+		gint err = -1;
+		gboolean success = FALSE;
+
+		if(pipe2(link,O_CLOEXEC) != 0)
+		{
+			g_set_error(error,g_quark_from_static_string("pipeline"),errno,
+					"Could not create pipeline: %s",g_strerror(errno));
+			break;
+		}
+		fds.in = previous;
+		fds.out = link[1];
+		fds.nice = pipeline->nice;
+		fds.ioprio = pipeline->ioprio;
+
+		success = g_spawn_async_with_pipes(NULL,stage->argv,NULL,flags,
+				setup_stage,&fds,&stage->pid,NULL,NULL,&err,error);
+		close(previous);
+		close(link[1]);
+		previous = link[0];
+		if(success == FALSE) break;
+
+		pipeline->running++;
+		g_child_watch_add(stage->pid,on_stage_exit,pipeline);
+		messages_watch(messages,err,stage->name);
+	}
+	if(iterator != NULL)
+	{
+		/* Stages already started see EOF and finish on their own */
+		close(previous);
+		if(target >= 0) close(target);
+		return FALSE;
+	}
+
+	/* Output of a single modapp is text for the message log */
+	if(target < 0)
+	{
+		messages_watch(messages,previous,NULL);
+		return TRUE;
+	}
+	else
+	{
+		GIOChannel *channel = NULL;
+		Sink *sink = g_new0(Sink,1);
+
+		sink->pipeline = pipeline;
+		sink->from = previous;
+		sink->to = target;
+		sink->spliced = TRUE;
+		pipeline->running++; /* The sink counts as a stage */
+
+		fcntl(sink->from,F_SETFL,fcntl(sink->from,F_GETFL) | O_NONBLOCK);
+		channel = g_io_channel_unix_new(sink->from);
+		g_io_add_watch(channel,G_IO_IN | G_IO_HUP | G_IO_ERR,on_output,sink);
+		g_io_channel_unref(channel);
+	}
+	return TRUE;
+}
+
+/* Destructor */
+void free_Pipeline(Pipeline *pipeline)
+{
+	GSList *iterator = NULL;
+
+	for(iterator = pipeline->stages;iterator;iterator = iterator->next)
+	{
+		Stage *stage = iterator->data;
+		g_strfreev(stage->argv);
+		g_free(stage->name);
+		g_free(stage);
+	}
+	g_slist_free(pipeline->stages);
+	g_free(pipeline->input);
+	g_free(pipeline->output);
+	g_free(pipeline);
+}
+
+/* Runs in the child just before exec */
+static void setup_stage(gpointer data)
+{
+	StageFds *fds = (StageFds *)data;
+
+	dup2(fds->in,STDIN_FILENO);
+	dup2(fds->out,STDOUT_FILENO);
+
+	/* Both only affect this child. The stage still runs if they fail */
+	errno = 0;
+	if(fds->nice != 0 && nice(fds->nice) == -1 && errno != 0)
+		report_setup("Could not lower the CPU priority\n");
+#ifdef SYS_ioprio_set
+	if(fds->ioprio != 0 && syscall(SYS_ioprio_set,IOPRIO_WHO_PROCESS,0,fds->ioprio) != 0)
+		report_setup("Could not lower the disk priority\n");
+#endif
+}
+
+/* Child only. stderr is already the error pipe of the stage */
+static void report_setup(const gchar *message)
+{
+	ssize_t written = write(STDERR_FILENO,message,strlen(message));
+	(void)written;
+}
+
+void pipeline_signal(Pipeline *pipeline,gint sig)
+{
+	GSList *iterator = NULL;
+
+	for(iterator = pipeline->stages;iterator;iterator = iterator->next)
+	{
+		Stage *stage = iterator->data;
+		if(stage->pid > 0) kill(stage->pid,sig);
+	}
+}
+
+static void on_stage_exit(GPid pid,gint status,gpointer data)
+{
+	Pipeline *pipeline = (Pipeline *)data;
+	GSList *iterator = NULL;
+
+	for(iterator = pipeline->stages;iterator;iterator = iterator->next)
+	{
+		Stage *stage = iterator->data;
+		if(stage->pid != pid) continue;
+		if(iterator->next == NULL) pipeline->status = status;
+		stage->pid = 0; /* Never signal a reused pid */
+	}
+	g_spawn_close_pid(pid);
+	finish_stage(pipeline);
+}
+
+static void finish_stage(Pipeline *pipeline)
+{
+	gchar *report = NULL;
+
+	pipeline->running--;
+	if(pipeline->running > 0) return;
+
+	if(pipeline->output != NULL)
+		report = g_strdup_printf("Finished with status %d (%" G_GUINT64_FORMAT " bytes to %s)",
+				pipeline->status,pipeline->written,pipeline->output);
+	else
+		report = g_strdup_printf("Finished with status %d",pipeline->status);
+	messages_append(pipeline->messages,report);
+	g_free(report);
+	if(pipeline->finished != NULL)
+		pipeline->finished(pipeline,pipeline->finished_data);
+	free_Pipeline(pipeline);
+}
+
+static gboolean on_output(GIOChannel *source,GIOCondition condition,gpointer data)
+{
+	Sink *sink = (Sink *)data;
+
+	if(move_output(sink)) return TRUE;
+
+	/* Last stage has closed its output */
+	fsync(sink->to);
+	close(sink->to);
+	close(sink->from);
+	finish_stage(sink->pipeline);
+	g_free(sink);
+	return FALSE;
+}
+
+/*
+ * Moves what is available from the pipeline to the output file.
+ * Returns FALSE at end of file or on error.
+ */
+static gboolean move_output(Sink *sink)
+{
+	gsize budget = SPLICE_BUDGET;
+
+	while(budget > 0)
+	{
+		gssize moved = -1;
+
+		if(sink->spliced)
+		{
+			moved = splice(sink->from,NULL,sink->to,NULL,SPLICE_CHUNK,
+					SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if(moved < 0 && errno == EINVAL)
+			{
+				/* Target filesystem cannot splice */
+				sink->spliced = FALSE;
+				continue;
+			}
+		}
+		else
+		{
+			gchar buffer[65536];
+			moved = read(sink->from,buffer,sizeof(buffer));
+			if(moved > 0 && write(sink->to,buffer,moved) != moved)
+				moved = -1;
+		}
+
+		if(moved == 0) return FALSE;
+		if(moved < 0)
+		{
+			if(errno == EAGAIN) return TRUE;
+			if(errno == EINTR) continue;
+			messages_append(sink->pipeline->messages,g_strerror(errno));
+			return FALSE;
+		}
+		sink->pipeline->written += moved;
+		budget -= MIN(budget,(gsize)moved);
+	}
+	return TRUE;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for pipelines of modapps (compress x then encrypt)
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+typedef struct pipeline_stage
+{
+	gchar **argv;
+	gchar *name; /* Shown in front of its error output */
+	GPid pid;
+}Stage;
+
+typedef struct process_pipeline
+{
+	GSList *stages; /* Holds Stage structs in order */
+	gchar *input; /* File fed to the first stage or NULL */
+	gchar *output; /* File receiving the last stage or NULL */
+	gint running; /* Stages not reaped yet */
+	gint status; /* Exit status of the last stage */
+	guint64 written; /* Bytes moved into output */
+	struct message_log *messages;
+
+	/* Scheduling of the children (see jobs.c) */
+	gint nice; /* Added to the niceness of every stage */
+	gint ioprio; /* Value for ioprio_set(2) or 0 to leave alone */
+	void (*finished)(struct process_pipeline *pipeline,gpointer data);
+	gpointer finished_data;
+}Pipeline;
+
+/* Constructor */
+Pipeline* create_Pipeline(void);
+
+/* Adds a stage at the end. The pipeline takes argv */
+void pipeline_add_stage(Pipeline *pipeline,gchar **argv);
+
+/*
+ * Starts all stages. The pipeline frees itself when they finish. On
+ * failure the caller still owns it, unless running is above 0: the
+ * stages already started free it when they finish.
+ */
+gboolean pipeline_start(Pipeline *pipeline,struct message_log *messages,GError **error);
+
+/* Sends sig to every stage still running */
+void pipeline_signal(Pipeline *pipeline,gint sig);
+
+/* Destructor */
+void free_Pipeline(Pipeline *pipeline);
+
+
+
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Every word of a sentence falls in a token class. The sentence is
+ * reduced to a feature vector with the count of each class and every
+ * kind of sentence gets the weighted sum of that vector. A softmax
+ * over the sums gives the confidence of each interpretation.
+ *
+ * The weights live in scoring.conf (system wide in PKGDATADIR and
+ * per user in ~/.elevate) so they can be tuned without a rebuild:
+ *
+ * [object]
+ * open = 1
+ * module = 1
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "score.h"
+
+#define SCORING_G "scoring"
+#define BIAS_G "bias"
+#define SHARP_P "sharpness"
+#define CONFIDENCE_P "min_confidence"
+
+static const gchar *class_names[TOKEN_CLASSES] = {
+	"application","launch_verb","open_verb","object",
+	"module","info_object","info_property","unknown",
+	"fuzzy_application","fuzzy_module"
+};
+
+static const gchar *type_names[SENTENCE_TYPES] = {
+	"application","launch","open","module","vault","information"
+};
+
+/* Constructor */
+Weights* create_Weights(void)
+{
+	Weights *result = NULL;
+
+	result = g_new0(Weights,1);
+	result->sharpness = 3;
+	result->min_confidence = 0.5;
+
+	/* 
+	 * Same tallies the parser always used. A bare application
+	 * counts a bit less for "launch" so ties have a winner.
+	 */
+	result->weight[TOKEN_APPLICATION][0] = 1;
+	result->weight[TOKEN_APPLICATION][1] = 0.8;
+	result->weight[TOKEN_LAUNCH_VERB][1] = 1;
+	result->weight[TOKEN_LAUNCH_VERB][2] = 1;
+	result->weight[TOKEN_OPEN_VERB][2] = 1;
+	result->weight[TOKEN_OBJECT][2] = 1;
+	result->weight[TOKEN_OBJECT][3] = 1;
+	result->weight[TOKEN_MODAPP][3] = 1;
+	result->weight[TOKEN_INFO_OBJECT][5] = 1;
+	result->weight[TOKEN_INFO_PROPERTY][5] = 1;
+	/* Corrected typos count less than exact keywords */
+	result->weight[TOKEN_FUZZY_APPLICATION][0] = 0.6;
+	result->weight[TOKEN_FUZZY_APPLICATION][1] = 0.5;
+	result->weight[TOKEN_FUZZY_MODAPP][3] = 0.6;
+
+	return result;
+}
+
+gboolean weights_load(Weights *weights,const gchar *path)
+{
+	GKeyFile *file = NULL;
+	GError *error = NULL;
+	int c;
+	int t;
+
+	file = g_key_file_new();
+	if(!g_key_file_load_from_file(file,path,G_KEY_FILE_NONE,&error))
+	{
+		g_debug("No scoring weights at %s: %s",path,error->message);
+		g_error_free(error);
+		g_key_file_free(file);
+		return FALSE;
+	}
+
+	if(g_key_file_has_key(file,SCORING_G,SHARP_P,NULL))
+		weights->sharpness = g_key_file_get_double(file,SCORING_G,SHARP_P,NULL);
+	if(g_key_file_has_key(file,SCORING_G,CONFIDENCE_P,NULL))
+		weights->min_confidence = g_key_file_get_double(file,SCORING_G,CONFIDENCE_P,NULL);
+
+	for(t=0;t<SENTENCE_TYPES;t++)
+	{
+		if(g_key_file_has_key(file,BIAS_G,type_names[t],NULL))
+			weights->bias[t] = g_key_file_get_double(file,BIAS_G,type_names[t],NULL);
+		for(c=0;c<TOKEN_CLASSES;c++)
+		{
+			if(g_key_file_has_key(file,class_names[c],type_names[t],NULL))
+				weights->weight[c][t] = g_key_file_get_double(file,class_names[c],type_names[t],NULL);
+		}
+	}
+
+	g_debug("Loaded scoring weights from %s",path);
+	g_key_file_free(file);
+	return TRUE;
+}
+
+/*
+ * One pass over the features. Candidates with no positive score are
+ * left out and on equal scores the lower sentence type wins.
+ */
+guint score_sentence(const Weights *weights,const guint8 *features,Candidate *top,guint k)
+{
+	gfloat scores[SENTENCE_TYPES];
+	gfloat best = 0;
+	gdouble total = 0;
+	guint count = 0;
+	int c;
+	int t;
+
+	memcpy(scores,weights->bias,sizeof(scores));
+	for(c=0;c<TOKEN_CLASSES;c++)
+	{
+		if(features[c] == 0) continue;
+		for(t=0;t<SENTENCE_TYPES;t++)
+			scores[t] += features[c] * weights->weight[c][t];
+	}
+
+	for(t=0;t<SENTENCE_TYPES;t++)
+		best = MAX(best,scores[t]);
+	if(best <= 0) return 0;
+
+	/* Softmax relative to the best score so exp() cannot overflow */
+	for(t=0;t<SENTENCE_TYPES;t++)
+		total += exp(weights->sharpness * (scores[t] - best));
+
+	/* Insertion into the short top list */
+	for(t=0;t<SENTENCE_TYPES;t++)
+	{
+		guint slot;
+
+		if(scores[t] <= 0) continue;
+		for(slot = count;slot > 0 && top[slot - 1].score < scores[t];slot--)
+			if(slot < k) top[slot] = top[slot - 1];
+		if(slot >= k) continue;
+
+		top[slot].type = t;
+		top[slot].score = scores[t];
+		top[slot].confidence = exp(weights->sharpness * (scores[t] - best)) / total;
+		if(count < k) count++;
+	}
+	return count;
+}
+
+const gchar *sentence_type_name(gint type)
+{
+	if(type < 0 || type >= SENTENCE_TYPES) return "unknown";
+	return type_names[type];
+}
+
+/* Destructor */
+void free_Weights(Weights *weights)
+{
+	g_free(weights);
+}
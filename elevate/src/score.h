@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the weighted scoring of sentences
+ */
+
+#ifndef SCORE_H
+#define SCORE_H
+
+/* Kinds of words the language recognises */
+typedef enum token_class
+{
+	TOKEN_APPLICATION,
+	TOKEN_LAUNCH_VERB,
+	TOKEN_OPEN_VERB,
+	TOKEN_OBJECT,
+	TOKEN_MODAPP,
+	TOKEN_INFO_OBJECT,
+	TOKEN_INFO_PROPERTY,
+	TOKEN_UNKNOWN,
+	TOKEN_FUZZY_APPLICATION, /* Misspelled application */
+	TOKEN_FUZZY_MODAPP /* Misspelled modapp */
+}TokenClass;
+
+#define TOKEN_CLASSES 10
+
+/* Kinds of sentences (see lang.c) */
+#define SENTENCE_TYPES 6
+
+/* Interpretations kept for every sentence */
+#define SCORE_TOP 3
+
+typedef struct scoring_weights
+{
+	gfloat weight[TOKEN_CLASSES][SENTENCE_TYPES];
+	gfloat bias[SENTENCE_TYPES];
+	gfloat sharpness; /* How fast confidence grows with the score gap */
+	gfloat min_confidence; /* Below this nothing is run */
+}Weights;
+
+typedef struct sentence_candidate
+{
+	gint type;
+	gfloat score;
+	gfloat confidence; /* 0-1, all candidates sum to at most 1 */
+}Candidate;
+
+/* Constructor. Built-in weights */
+Weights* create_Weights(void);
+
+/* Overrides weights with the ones found in a scoring file */
+gboolean weights_load(Weights *weights,const gchar *path);
+
+/* 
+ * Scores the feature vector (count of every token class) and fills
+ * top with at most k candidates, best first. Returns how many.
+ */
+guint score_sentence(const Weights *weights,const guint8 *features,Candidate *top,guint k);
+
+const gchar *sentence_type_name(gint type);
+
+/* Destructor */
+void free_Weights(Weights *weights);
+
+
+
+
+#endif
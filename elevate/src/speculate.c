@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Between keystrokes elevate only redraws. The speculator uses that
+ * time: after every key the partial sentence is parsed and a worker
+ * thread warms up what the best guess will need. The object being
+ * typed is stat()ed and read ahead into the page cache and the
+ * binary of the guessed application or module is looked up in $PATH
+ * and its pages are prefetched with posix_fadvise.
+ *
+ * Every new guess bumps a generation counter. The worker checks it
+ * between steps and drops work that no longer matches the input.
+ * When Return is pressed the final sentence is compared with the
+ * last finished speculation to keep a hit rate.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "messages.h"
+#include "app.h"
+#include "modapp.h"
+#include "engine.h"
+#include "score.h"
+#include "lang.h"
+#include "speculate.h"
+
+/* Objects are read ahead in chunks so that cancelling is quick */
+#define SPECULATE_CHUNK (1024 * 1024)
+#define SPECULATE_MAX (16 * SPECULATE_CHUNK)
+
+G_LOCK_DEFINE_STATIC(warm);
+
+static gpointer speculate_worker(gpointer data);
+static void read_guess(Engine *eng,const gchar *input,gchar **object,gchar **command);
+static gboolean prewarm_object(Speculator *spec,Guess *guess);
+static gboolean prewarm_program(Speculator *spec,Guess *guess);
+static gboolean is_stale(Speculator *spec,Guess *guess);
+static void free_Guess(Guess *guess);
+
+/* Constructor */
+Speculator* create_Speculator(void)
+{
+	Speculator *result = NULL;
+	GError *error = NULL;
+
+	result = g_new0(Speculator,1);
+	result->requests = g_async_queue_new();
+	result->worker = g_thread_create(speculate_worker,result,TRUE,&error);
+	if(result->worker == NULL)
+	{
+		/* Everything still works, just without prewarming */
+		g_warning("Could not start speculation thread: %s",error->message);
+		g_error_free(error);
+	}
+
+	return result;
+}
+
+void speculate_guess(Speculator *spec,Engine *eng,const gchar *input)
+{
+	gchar *object = NULL;
+	gchar *command = NULL;
+	Guess *guess = NULL;
+
+	if(spec->worker == NULL) return;
+
+	read_guess(eng,input,&object,&command);
+
+	/* Same guess as before, the worker already has it */
+	if(g_strcmp0(object,spec->object) == 0 && g_strcmp0(command,spec->command) == 0)
+	{
+		g_free(object);
+		g_free(command);
+		return;
+	}
+	g_free(spec->object);
+	g_free(spec->command);
+	spec->object = object;
+	spec->command = command;
+
+	g_atomic_int_inc(&spec->generation);
+	if(object == NULL && command == NULL) return;
+
+	guess = g_new0(Guess,1);
+	guess->generation = g_atomic_int_get(&spec->generation);
+	guess->object = g_strdup(object);
+	guess->command = g_strdup(command);
+	g_async_queue_push(spec->requests,guess);
+}
+
+void speculate_commit(Speculator *spec,Engine *eng,const gchar *input)
+{
+	gchar *object = NULL;
+	gchar *command = NULL;
+	gboolean hit = FALSE;
+
+	if(spec->worker == NULL) return;
+
+	read_guess(eng,input,&object,&command);
+	if(object != NULL || command != NULL)
+	{
+		spec->guesses++;
+
+		G_LOCK(warm);
+		hit = (g_strcmp0(object,spec->warm_object) == 0 &&
+				g_strcmp0(command,spec->warm_command) == 0);
+		if(hit)
+		{
+			spec->hits++;
+			spec->saved += spec->warm_seconds;
+		}
+		G_UNLOCK(warm);
+		g_debug("Speculation %s for %s",hit ? "hit" : "missed",input);
+	}
+	g_free(object);
+	g_free(command);
+
+	/* The input box is empty again */
+	speculate_guess(spec,eng,"");
+}
+
+gchar *speculate_report(Speculator *spec)
+{
+	guint percent = 0;
+
+	if(spec->guesses > 0) percent = spec->hits * 100 / spec->guesses;
+	return g_strdup_printf("Prewarmed %d of %d sentences (%d%%), saved %.3f seconds, %d guesses dropped",
+			spec->hits,spec->guesses,percent,spec->saved,
+			g_atomic_int_get(&spec->cancelled));
+}
+
+/* Destructor */
+void free_Speculator(Speculator *spec)
+{
+	gchar *report = NULL;
+
+	if(spec->worker != NULL)
+	{
+		g_atomic_int_set(&spec->quit,1);
+		g_async_queue_push(spec->requests,g_new0(Guess,1));
+		g_thread_join(spec->worker);
+	}
+
+	report = speculate_report(spec);
+	g_message("%s",report);
+	g_free(report);
+
+	g_async_queue_unref(spec->requests);
+	g_free(spec->object);
+	g_free(spec->command);
+	g_free(spec->warm_object);
+	g_free(spec->warm_command);
+	g_free(spec);
+}
+
+static gpointer speculate_worker(gpointer data)
+{
+	Speculator *spec = (Speculator *)data;
+
+	while(TRUE)
+	{
+		Guess *guess = g_async_queue_pop(spec->requests);
+		GTimer *timer = NULL;
+		gboolean done = TRUE;
+
+		if(g_atomic_int_get(&spec->quit))
+		{
+			free_Guess(guess);
+			break;
+		}
+
+		timer = g_timer_new();
+		if(guess->object != NULL) done = prewarm_object(spec,guess);
+		if(done && guess->command != NULL) done = prewarm_program(spec,guess);
+
+		if(done && !is_stale(spec,guess))
+		{
+			G_LOCK(warm);
+			g_free(spec->warm_object);
+			g_free(spec->warm_command);
+			spec->warm_object = guess->object;
+			spec->warm_command = guess->command;
+			spec->warm_seconds = g_timer_elapsed(timer,NULL);
+			G_UNLOCK(warm);
+			guess->object = NULL;
+			guess->command = NULL;
+		}
+		else
+		{
+			g_atomic_int_inc(&spec->cancelled);
+		}
+		g_timer_destroy(timer);
+		free_Guess(guess);
+	}
+	return NULL;
+}
+
+/*
+ * Parses the (maybe partial) input and returns the first object
+ * and the command of the first application or module found.
+ */
+static void read_guess(Engine *eng,const gchar *input,gchar **object,gchar **command)
+{
+	Language *lang = NULL;
+	Sentence *sen = NULL;
+	gchar *copy = NULL;
+
+	*object = NULL;
+	*command = NULL;
+	if(eng == NULL || input == NULL || input[0] == '\0') return;
+
+	copy = g_strdup(input);
+	lang = create_Language(eng);
+	process(lang,copy);
+
+	for(sen = lang->sen;sen;sen = sen->next)
+	{
+		if(*object == NULL && sen->object != NULL)
+			*object = g_strdup(sen->object);
+		if(*command == NULL && sen->application != NULL)
+		{
+			App *app = find_application(eng,sen->application);
+			if(app != NULL) *command = g_strdup(app->command);
+		}
+		if(*command == NULL && sen->module != NULL)
+		{
+			Modapp *mod = find_modapp(eng,sen->module);
+			if(mod != NULL) *command = g_strdup(mod->command);
+		}
+	}
+
+	free_Language(lang);
+	g_free(copy);
+}
+
+/* Reads the start of the object into the page cache */
+static gboolean prewarm_object(Speculator *spec,Guess *guess)
+{
+	struct stat info;
+	off_t offset = 0;
+	int fd = -1;
+
+	if(g_stat(guess->object,&info) != 0 || !S_ISREG(info.st_mode)) return TRUE;
+
+	fd = open(guess->object,O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return TRUE;
+
+	while(offset < info.st_size && offset < SPECULATE_MAX)
+	{
+		if(is_stale(spec,guess))
+		{
+			close(fd);
+			return FALSE;
+		}
+		readahead(fd,offset,SPECULATE_CHUNK);
+		offset += SPECULATE_CHUNK;
+	}
+	close(fd);
+	return TRUE;
+}
+
+/* Resolves the binary in $PATH and prefetches its pages */
+static gboolean prewarm_program(Speculator *spec,Guess *guess)
+{
+	gchar **argv = NULL;
+	gchar *path = NULL;
+	int fd = -1;
+
+	if(!g_shell_parse_argv(guess->command,NULL,&argv,NULL)) return TRUE;
+	path = g_find_program_in_path(argv[0]);
+	g_strfreev(argv);
+	if(path == NULL || is_stale(spec,guess))
+	{
+		g_free(path);
+		return !is_stale(spec,guess);
+	}
+
+	fd = open(path,O_RDONLY | O_CLOEXEC);
+	if(fd >= 0)
+	{
+		posix_fadvise(fd,0,0,POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+	g_free(path);
+	return TRUE;
+}
+
+static gboolean is_stale(Speculator *spec,Guess *guess)
+{
+	return g_atomic_int_get(&spec->generation) != guess->generation;
+}
+
+static void free_Guess(Guess *guess)
+{
+	g_free(guess->object);
+	g_free(guess->command);
+	g_free(guess);
+}
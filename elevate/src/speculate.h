@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Header for the speculative prewarming done while the user types
+ */
+
+#ifndef SPECULATE_H
+#define SPECULATE_H
+
+typedef struct speculation_request
+{
+	gint generation; /* Stale once the guess changes */
+	gchar *object; /* Path being typed or NULL */
+	gchar *command; /* Command line of the guessed app/modapp or NULL */
+}Guess;
+
+typedef struct speculator
+{
+	GThread *worker;
+	GAsyncQueue *requests;
+	volatile gint generation; /* Bumped for every new guess */
+	volatile gint quit;
+
+	/* Last guess sent to the worker (GTK thread only) */
+	gchar *object;
+	gchar *command;
+
+	/* Last finished speculation, protected by a lock */
+	gchar *warm_object;
+	gchar *warm_command;
+	gdouble warm_seconds; /* Time the worker spent on it */
+
+	/* Hit rate */
+	guint guesses; /* Sentences submitted */
+	guint hits; /* Sentences that found their files warm */
+	gdouble saved; /* Seconds of work done before Return */
+	guint cancelled; /* Speculations dropped half-way */
+}Speculator;
+
+/* Constructor. Starts the worker thread */
+Speculator* create_Speculator(void);
+
+/* Called for every keystroke with the partial input */
+void speculate_guess(Speculator *spec,Engine *eng,const gchar *input);
+
+/* Called on Return. Counts hits and clears the guess */
+void speculate_commit(Speculator *spec,Engine *eng,const gchar *input);
+
+/* One line with the hit rate and the saved time */
+gchar *speculate_report(Speculator *spec);
+
+/* Destructor. Stops the worker thread */
+void free_Speculator(Speculator *spec);
+
+
+
+
+#endif
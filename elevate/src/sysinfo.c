@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2010 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Project Elevate - Core 
+ */
+
+/*
+ * Native provider of system information (see elevate_plugin.h).
+ * Everything is read from /proc and statvfs() so a question such
+ * as "show me the free memory" never starts a process.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <glib.h>
+
+#include "elevate_plugin.h"
+
+#define CPUINFO "/proc/cpuinfo"
+#define MEMINFO "/proc/meminfo"
+
+static gchar *read_field(const gchar *filename,const gchar *field);
+static gboolean is_property(const gchar *property,const gchar *name);
+
+gint elevate_plugin_abi(void)
+{
+	return ELEVATE_PLUGIN_ABI;
+}
+
+/* Model of the first processor or its speed */
+gboolean sysinfo_cpu(const gchar *object,const gchar *property,InfoValue *result)
+{
+	gchar *value = NULL;
+
+	if(is_property(property,"speed") || is_property(property,"megaherz"))
+	{
+		value = read_field(CPUINFO,"cpu MHz");
+		if(value == NULL) return FALSE;
+		result->type = INFO_DOUBLE;
+		result->real = g_ascii_strtod(value,NULL);
+		result->unit = "MHz";
+		g_free(value);
+		return TRUE;
+	}
+
+	value = read_field(CPUINFO,"model name");
+	if(value == NULL) return FALSE;
+	result->type = INFO_STRING;
+	result->string = value;
+	return TRUE;
+}
+
+/* Available memory, or all of it when asked for the size */
+gboolean sysinfo_memory(const gchar *object,const gchar *property,InfoValue *result)
+{
+	gchar *value = NULL;
+
+	if(is_property(property,"size"))
+		value = read_field(MEMINFO,"MemTotal");
+	else
+	{
+		value = read_field(MEMINFO,"MemAvailable");
+		/* Kernels before 3.14 */
+		if(value == NULL) value = read_field(MEMINFO,"MemFree");
+	}
+	if(value == NULL) return FALSE;
+
+	result->type = INFO_INT;
+	result->integer = g_ascii_strtoll(value,NULL,10) / 1024;
+	result->unit = "MB";
+	g_free(value);
+	return TRUE;
+}
+
+/* Space left in the home directory, or its size */
+gboolean sysinfo_disk(const gchar *object,const gchar *property,InfoValue *result)
+{
+	struct statvfs info;
+	guint64 blocks;
+
+	if(statvfs(g_get_home_dir(),&info) != 0) return FALSE;
+
+	blocks = is_property(property,"size") ? info.f_blocks : info.f_bavail;
+	result->type = INFO_DOUBLE;
+	result->real = (gdouble)blocks * info.f_frsize / (1024.0 * 1024.0 * 1024.0);
+	result->unit = "GB";
+	return TRUE;
+}
+
+/* Value of the first "field : value" line of a /proc file */
+static gchar *read_field(const gchar *filename,const gchar *field)
+{
+	gchar line[256];
+	gchar *result = NULL;
+	gsize length = strlen(field);
+	FILE *file = NULL;
+
+	file = fopen(filename,"r");
+	if(file == NULL) return NULL;
+	while(result == NULL && fgets(line,sizeof(line),file) != NULL)
+	{
+		gchar *value = NULL;
+
+		if(strncmp(line,field,length) != 0) continue;
+		value = strchr(line + length,':');
+		if(value == NULL) continue;
+		/* Units such as "kB" are dropped by the callers */
+		result = g_strstrip(g_strdup(value + 1));
+	}
+	fclose(file);
+	return result;
+}
+
+static gboolean is_property(const gchar *property,const gchar *name)
+{
+	return property != NULL && g_ascii_strcasecmp(property,name) == 0;
+}
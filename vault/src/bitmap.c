@@ -0,0 +1,580 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+#include <string.h>
+#include <glib.h>
+#include "bitmap.h"
+
+/*
+ * Set operations work container by container. Two arrays are
+ * merged, an array against bits tests each value and two sets of
+ * bits are combined a word at a time. The word loops are plain
+ * enough for the compiler to vectorise them.
+ */
+
+/* Written layout of one container */
+typedef struct written_container
+{
+	guint16 key;
+	guint16 dense;
+	guint32 cardinality;
+	guint32 offset; /* From the start of the bitmap */
+	guint32 reserved;
+}WrittenContainer;
+
+#define ALIGN8(n) (((n) + 7) & ~(gsize)7)
+#define HAS_BIT(words,v) (((words)[(v) >> 6] >> ((v) & 63)) & 1)
+#define SET_BIT(words,v) ((words)[(v) >> 6] |= (guint64)1 << ((v) & 63))
+
+static Container *find_container(Bitmap *bitmap,guint16 key);
+static void container_add(Container *container,guint16 low);
+static guint32 array_capacity(guint32 cardinality);
+static guint64 *container_words(const Container *container);
+static void append_copy(Bitmap *result,const Container *container);
+static void append_array(Bitmap *result,guint16 key,guint16 *values,guint32 cardinality);
+static void append_words(Bitmap *result,guint16 key,guint64 *words);
+static guint32 count_words(const guint64 *words);
+static guint popcount(guint64 bits);
+
+/* Constructor */
+Bitmap *create_Bitmap(void)
+{
+	Bitmap *result = g_new0(Bitmap,1);
+	result->containers = g_array_new(FALSE,FALSE,sizeof(Container));
+	result->owned = TRUE;
+	return result;
+}
+
+void bitmap_add(Bitmap *bitmap,guint32 value)
+{
+	Container *container = find_container(bitmap,value >> 16);
+	container_add(container,value & 0xffff);
+}
+
+guint64 bitmap_cardinality(const Bitmap *bitmap)
+{
+	guint64 total = 0;
+	guint i;
+
+	for(i = 0;i < bitmap->containers->len;i++)
+		total += g_array_index(bitmap->containers,Container,i).cardinality;
+	return total;
+}
+
+Bitmap *bitmap_and(const Bitmap *first,const Bitmap *second)
+{
+	Bitmap *result = create_Bitmap();
+	guint i = 0;
+	guint j = 0;
+
+	while(i < first->containers->len && j < second->containers->len)
+	{
+		const Container *a = &g_array_index(first->containers,Container,i);
+		const Container *b = &g_array_index(second->containers,Container,j);
+
+		if(a->key < b->key) { i++; continue; }
+		if(a->key > b->key) { j++; continue; }
+
+		if(a->dense && b->dense)
+		{
+			const guint64 *x = a->data;
+			const guint64 *y = b->data;
+			guint64 *words = g_new(guint64,BITMAP_WORDS);
+			guint w;
+
+			for(w = 0;w < BITMAP_WORDS;w++) words[w] = x[w] & y[w];
+			append_words(result,a->key,words);
+		}
+		else if(!a->dense && !b->dense)
+		{
+			const guint16 *x = a->data;
+			const guint16 *y = b->data;
+			guint16 *values = g_new(guint16,MIN(a->cardinality,b->cardinality) + 1);
+			guint32 n = 0;
+			guint32 p = 0;
+			guint32 q = 0;
+
+			while(p < a->cardinality && q < b->cardinality)
+			{
+				if(x[p] < y[q]) p++;
+				else if(x[p] > y[q]) q++;
+				else { values[n++] = x[p]; p++; q++; }
+			}
+			append_array(result,a->key,values,n);
+		}
+		else
+		{
+			/* One array against bits */
+			const Container *array = a->dense ? b : a;
+			const Container *dense = a->dense ? a : b;
+			const guint16 *x = array->data;
+			const guint64 *bits = dense->data;
+			guint16 *values = g_new(guint16,array->cardinality + 1);
+			guint32 n = 0;
+			guint32 p;
+
+			for(p = 0;p < array->cardinality;p++)
+				if(HAS_BIT(bits,x[p])) values[n++] = x[p];
+			append_array(result,a->key,values,n);
+		}
+		i++;
+		j++;
+	}
+	return result;
+}
+
+Bitmap *bitmap_or(const Bitmap *first,const Bitmap *second)
+{
+	Bitmap *result = create_Bitmap();
+	guint i = 0;
+	guint j = 0;
+
+	while(i < first->containers->len || j < second->containers->len)
+	{
+		const Container *a = NULL;
+		const Container *b = NULL;
+
+		if(i < first->containers->len) a = &g_array_index(first->containers,Container,i);
+		if(j < second->containers->len) b = &g_array_index(second->containers,Container,j);
+
+		if(b == NULL || (a != NULL && a->key < b->key))
+		{
+			append_copy(result,a);
+			i++;
+			continue;
+		}
+		if(a == NULL || b->key < a->key)
+		{
+			append_copy(result,b);
+			j++;
+			continue;
+		}
+
+		if(!a->dense && !b->dense && a->cardinality + b->cardinality <= BITMAP_ARRAY_MAX)
+		{
+			const guint16 *x = a->data;
+			const guint16 *y = b->data;
+			guint16 *values = g_new(guint16,a->cardinality + b->cardinality + 1);
+			guint32 n = 0;
+			guint32 p = 0;
+			guint32 q = 0;
+
+			while(p < a->cardinality || q < b->cardinality)
+			{
+				if(q >= b->cardinality || (p < a->cardinality && x[p] < y[q])) values[n++] = x[p++];
+				else if(p >= a->cardinality || y[q] < x[p]) values[n++] = y[q++];
+				else { values[n++] = x[p]; p++; q++; }
+			}
+			append_array(result,a->key,values,n);
+		}
+		else
+		{
+			const Container *other = a->dense ? b : a;
+			guint64 *words = container_words(a->dense ? a : b);
+
+			if(other->dense)
+			{
+				const guint64 *y = other->data;
+				guint w;
+				for(w = 0;w < BITMAP_WORDS;w++) words[w] |= y[w];
+			}
+			else
+			{
+				const guint16 *y = other->data;
+				guint32 q;
+				for(q = 0;q < other->cardinality;q++) SET_BIT(words,y[q]);
+			}
+			append_words(result,a->key,words);
+		}
+		i++;
+		j++;
+	}
+	return result;
+}
+
+Bitmap *bitmap_andnot(const Bitmap *first,const Bitmap *second)
+{
+	Bitmap *result = create_Bitmap();
+	guint i;
+	guint j = 0;
+
+	for(i = 0;i < first->containers->len;i++)
+	{
+		const Container *a = &g_array_index(first->containers,Container,i);
+		const Container *b = NULL;
+
+		while(j < second->containers->len && g_array_index(second->containers,Container,j).key < a->key) j++;
+		if(j < second->containers->len && g_array_index(second->containers,Container,j).key == a->key)
+			b = &g_array_index(second->containers,Container,j);
+
+		if(b == NULL)
+		{
+			append_copy(result,a);
+			continue;
+		}
+
+		if(a->dense)
+		{
+			guint64 *words = container_words(a);
+
+			if(b->dense)
+			{
+				const guint64 *y = b->data;
+				guint w;
+				for(w = 0;w < BITMAP_WORDS;w++) words[w] &= ~y[w];
+			}
+			else
+			{
+				const guint16 *y = b->data;
+				guint32 q;
+				for(q = 0;q < b->cardinality;q++) words[y[q] >> 6] &= ~((guint64)1 << (y[q] & 63));
+			}
+			append_words(result,a->key,words);
+		}
+		else
+		{
+			const guint16 *x = a->data;
+			guint16 *values = g_new(guint16,a->cardinality + 1);
+			guint32 n = 0;
+			guint32 p;
+			guint32 q = 0;
+
+			for(p = 0;p < a->cardinality;p++)
+			{
+				if(b->dense)
+				{
+					if(!HAS_BIT((const guint64 *)b->data,x[p])) values[n++] = x[p];
+					continue;
+				}
+				while(q < b->cardinality && ((const guint16 *)b->data)[q] < x[p]) q++;
+				if(q >= b->cardinality || ((const guint16 *)b->data)[q] != x[p]) values[n++] = x[p];
+			}
+			append_array(result,a->key,values,n);
+		}
+	}
+	return result;
+}
+
+void bitmap_values(const Bitmap *bitmap,GArray *values)
+{
+	guint i;
+
+	for(i = 0;i < bitmap->containers->len;i++)
+	{
+		const Container *container = &g_array_index(bitmap->containers,Container,i);
+		guint32 high = (guint32)container->key << 16;
+
+		if(container->dense)
+		{
+			const guint64 *words = container->data;
+			guint w;
+
+			for(w = 0;w < BITMAP_WORDS;w++)
+			{
+				guint64 bits = words[w];
+				while(bits != 0)
+				{
+					guint32 value = high | (w << 6) | __builtin_ctzll(bits);
+					g_array_append_val(values,value);
+					bits &= bits - 1;
+				}
+			}
+		}
+		else
+		{
+			const guint16 *low = container->data;
+			guint32 p;
+
+			for(p = 0;p < container->cardinality;p++)
+			{
+				guint32 value = high | low[p];
+				g_array_append_val(values,value);
+			}
+		}
+	}
+}
+
+gsize bitmap_write(const Bitmap *bitmap,GString *out)
+{
+	gsize start = ALIGN8(out->len);
+	gsize data = 0;
+	guint32 count = bitmap->containers->len;
+	guint32 reserved = 0;
+	guint i;
+
+	while(out->len < start) g_string_append_c(out,'\0');
+	g_string_append_len(out,(const gchar *)&count,sizeof(count));
+	g_string_append_len(out,(const gchar *)&reserved,sizeof(reserved));
+
+	/* Headers first, then the data of each container */
+	data = 8 + count * sizeof(WrittenContainer);
+	for(i = 0;i < count;i++)
+	{
+		const Container *container = &g_array_index(bitmap->containers,Container,i);
+		WrittenContainer written;
+
+		written.key = container->key;
+		written.dense = container->dense;
+		written.cardinality = container->cardinality;
+		written.offset = data;
+		written.reserved = 0;
+		g_string_append_len(out,(const gchar *)&written,sizeof(written));
+
+		data += ALIGN8(container->dense ? BITMAP_WORDS * sizeof(guint64) : container->cardinality * sizeof(guint16));
+	}
+	for(i = 0;i < count;i++)
+	{
+		const Container *container = &g_array_index(bitmap->containers,Container,i);
+		gsize size = container->dense ? BITMAP_WORDS * sizeof(guint64) : container->cardinality * sizeof(guint16);
+
+		g_string_append_len(out,container->data,size);
+		while(out->len % 8 != 0) g_string_append_c(out,'\0');
+	}
+	return start;
+}
+
+Bitmap *bitmap_view(const guint8 *data,gsize size)
+{
+	Bitmap *result = NULL;
+	const WrittenContainer *written = NULL;
+	guint32 count;
+	guint32 i;
+
+	if(size < 8) return NULL;
+	count = *(const guint32 *)data;
+	if(8 + (guint64)count * sizeof(WrittenContainer) > size) return NULL;
+	written = (const WrittenContainer *)(data + 8);
+
+	result = create_Bitmap();
+	result->owned = FALSE;
+	for(i = 0;i < count;i++)
+	{
+		Container container;
+		gsize length = written[i].dense ? BITMAP_WORDS * sizeof(guint64) : written[i].cardinality * sizeof(guint16);
+
+		if(written[i].offset % 8 != 0 || (guint64)written[i].offset + length > size ||
+				(!written[i].dense && written[i].cardinality > BITMAP_ARRAY_MAX))
+		{
+			free_Bitmap(result);
+			return NULL;
+		}
+		container.key = written[i].key;
+		container.dense = written[i].dense;
+		container.cardinality = written[i].cardinality;
+		container.data = (gpointer)(data + written[i].offset);
+		g_array_append_val(result->containers,container);
+	}
+	return result;
+}
+
+/* Destructor */
+void free_Bitmap(Bitmap *bitmap)
+{
+	guint i;
+
+	if(bitmap->owned)
+		for(i = 0;i < bitmap->containers->len;i++)
+			g_free(g_array_index(bitmap->containers,Container,i).data);
+	g_array_free(bitmap->containers,TRUE);
+	g_free(bitmap);
+}
+
+/* Container for key, created if needed */
+static Container *find_container(Bitmap *bitmap,guint16 key)
+{
+	GArray *containers = bitmap->containers;
+	Container fresh;
+	guint low = 0;
+	guint high = containers->len;
+
+	/* Values usually come in order */
+	if(high > 0 && g_array_index(containers,Container,high - 1).key == key)
+		return &g_array_index(containers,Container,high - 1);
+	if(high == 0 || g_array_index(containers,Container,high - 1).key < key)
+		low = high;
+
+	while(low < high)
+	{
+		guint middle = (low + high) / 2;
+		guint16 other = g_array_index(containers,Container,middle).key;
+
+		if(other == key) return &g_array_index(containers,Container,middle);
+		if(other < key) low = middle + 1;
+		else high = middle;
+	}
+
+	memset(&fresh,0,sizeof(fresh));
+	fresh.key = key;
+	g_array_insert_val(containers,low,fresh);
+	return &g_array_index(containers,Container,low);
+}
+
+static void container_add(Container *container,guint16 low)
+{
+	guint16 *values = container->data;
+	guint32 position = container->cardinality;
+
+	if(container->dense)
+	{
+		guint64 *words = container->data;
+		if(HAS_BIT(words,low)) return;
+		SET_BIT(words,low);
+		container->cardinality++;
+		return;
+	}
+
+	/* Find where it goes, the end for ascending input */
+	if(position > 0 && values[position - 1] >= low)
+	{
+		guint32 first = 0;
+		guint32 last = position;
+
+		while(first < last)
+		{
+			guint32 middle = (first + last) / 2;
+			if(values[middle] < low) first = middle + 1;
+			else last = middle;
+		}
+		if(values[first] == low) return;
+		position = first;
+	}
+
+	if(container->cardinality == BITMAP_ARRAY_MAX)
+	{
+		guint64 *words = container_words(container);
+		g_free(container->data);
+		container->data = words;
+		container->dense = TRUE;
+		SET_BIT(words,low);
+		container->cardinality++;
+		return;
+	}
+	if(container->cardinality == array_capacity(container->cardinality))
+		container->data = values = g_renew(guint16,values,MAX(4,container->cardinality * 2));
+
+	memmove(values + position + 1,values + position,(container->cardinality - position) * sizeof(guint16));
+	values[position] = low;
+	container->cardinality++;
+}
+
+/* Arrays grow by doubling */
+static guint32 array_capacity(guint32 cardinality)
+{
+	guint32 capacity = 4;
+
+	if(cardinality == 0) return 0;
+	while(capacity < cardinality) capacity *= 2;
+	return capacity;
+}
+
+/* New words with the values of a container */
+static guint64 *container_words(const Container *container)
+{
+	guint64 *words = NULL;
+	const guint16 *values = container->data;
+	guint32 p;
+
+	if(container->dense) return g_memdup(container->data,BITMAP_WORDS * sizeof(guint64));
+
+	words = g_new0(guint64,BITMAP_WORDS);
+	for(p = 0;p < container->cardinality;p++) SET_BIT(words,values[p]);
+	return words;
+}
+
+static void append_copy(Bitmap *result,const Container *container)
+{
+	Container copy = *container;
+	gsize size = container->dense ? BITMAP_WORDS * sizeof(guint64) : container->cardinality * sizeof(guint16);
+
+	if(container->dense) copy.data = g_memdup(container->data,size);
+	else
+	{
+		/* Arrays keep room to grow */
+		copy.data = g_new(guint16,array_capacity(container->cardinality));
+		memcpy(copy.data,container->data,size);
+	}
+	g_array_append_val(result->containers,copy);
+}
+
+/* Takes values. Empty containers are not kept */
+static void append_array(Bitmap *result,guint16 key,guint16 *values,guint32 cardinality)
+{
+	Container container;
+
+	if(cardinality == 0)
+	{
+		g_free(values);
+		return;
+	}
+	container.key = key;
+	container.dense = FALSE;
+	container.cardinality = cardinality;
+	container.data = g_renew(guint16,values,array_capacity(cardinality));
+	g_array_append_val(result->containers,container);
+}
+
+/* Takes words. Small results become arrays again */
+static void append_words(Bitmap *result,guint16 key,guint64 *words)
+{
+	Container container;
+	guint32 cardinality = count_words(words);
+
+	if(cardinality <= BITMAP_ARRAY_MAX)
+	{
+		guint16 *values = g_new(guint16,MAX(array_capacity(cardinality),1));
+		guint32 n = 0;
+		guint w;
+
+		for(w = 0;w < BITMAP_WORDS;w++)
+		{
+			guint64 bits = words[w];
+			while(bits != 0)
+			{
+				values[n++] = (w << 6) | __builtin_ctzll(bits);
+				bits &= bits - 1;
+			}
+		}
+		g_free(words);
+		append_array(result,key,values,cardinality);
+		return;
+	}
+	container.key = key;
+	container.dense = TRUE;
+	container.cardinality = cardinality;
+	container.data = words;
+	g_array_append_val(result->containers,container);
+}
+
+static guint32 count_words(const guint64 *words)
+{
+	guint32 total = 0;
+	guint w;
+
+	for(w = 0;w < BITMAP_WORDS;w++) total += popcount(words[w]);
+	return total;
+}
+
+/* Branch free, so that the word loops stay vectorisable */
+static guint popcount(guint64 bits)
+{
+	bits = bits - ((bits >> 1) & G_GUINT64_CONSTANT(0x5555555555555555));
+	bits = (bits & G_GUINT64_CONSTANT(0x3333333333333333)) + ((bits >> 2) & G_GUINT64_CONSTANT(0x3333333333333333));
+	bits = (bits + (bits >> 4)) & G_GUINT64_CONSTANT(0x0f0f0f0f0f0f0f0f);
+	return (bits * G_GUINT64_CONSTANT(0x0101010101010101)) >> 56;
+}
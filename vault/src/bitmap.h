@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+/*
+ * Compressed bitmaps of file ids (in the spirit of Roaring bitmaps).
+ * Values are split by their high 16 bits into containers. A container
+ * with few values keeps them as a sorted array of the low 16 bits,
+ * a full one keeps all 65536 bits.
+ */
+
+/* Values above this are kept as bits */
+#define BITMAP_ARRAY_MAX 4096
+/* 65536 bits */
+#define BITMAP_WORDS 1024
+
+typedef struct bitmap_container
+{
+	guint16 key; /* High 16 bits of the values */
+	guint16 dense; /* data is BITMAP_WORDS words instead of values */
+	guint32 cardinality;
+	gpointer data; /* guint16 values or guint64 words */
+}Container;
+
+typedef struct compressed_bitmap
+{
+	GArray *containers; /* Container, ascending key */
+	gboolean owned; /* FALSE when the data lives in a mapped file */
+}Bitmap;
+
+/* Constructor. An empty bitmap */
+Bitmap *create_Bitmap(void);
+
+/* Adds a value. Adding in ascending order is fastest */
+void bitmap_add(Bitmap *bitmap,guint32 value);
+
+/* Number of values */
+guint64 bitmap_cardinality(const Bitmap *bitmap);
+
+/* New bitmaps with the values in both, in any, and in first but not second */
+Bitmap *bitmap_and(const Bitmap *first,const Bitmap *second);
+Bitmap *bitmap_or(const Bitmap *first,const Bitmap *second);
+Bitmap *bitmap_andnot(const Bitmap *first,const Bitmap *second);
+
+/* Appends all values (guint32) in ascending order */
+void bitmap_values(const Bitmap *bitmap,GArray *values);
+
+/* Appends the bitmap to out (8 byte aligned). Returns where it starts */
+gsize bitmap_write(const Bitmap *bitmap,GString *out);
+
+/* A read only bitmap over a written one. NULL if it is damaged */
+Bitmap *bitmap_view(const guint8 *data,gsize size);
+
+/* Destructor */
+void free_Bitmap(Bitmap *bitmap);
+
+#endif
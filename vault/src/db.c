@@ -17,7 +17,11 @@
  *
  * Vault -- The storage component of Project Elevate.
 */
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/file.h>
 #include <glib.h>
 #include <sqlite3.h>
 #include "vault.h"
@@ -44,6 +48,89 @@ static void create_table(sqlite3 *db,gchar *sql)
 	sqlite3_free(zErrMsg);
 }
 
+/* One entry per schema version after the first */
+static const gchar *migrations[SCHEMA_VERSION][12] =
+{
+	{ TABLE_JOURNAL, NULL },
+	{ INDEX_MATCH_TAG, INDEX_MATCH_FILE, NULL },
+	{ TABLE_SEARCH, FILL_SEARCH, TRIGGER_FILE_INSERT, TRIGGER_FILE_UPDATE, TRIGGER_FILE_DELETE,
+		TRIGGER_MATCH_INSERT, TRIGGER_MATCH_DELETE, NULL },
+	{ COLUMN_TAG_COUNT, FILL_TAG_COUNT, TRIGGER_COUNT_INSERT, TRIGGER_COUNT_DELETE, NULL },
+	{ TABLE_STATS, FILL_STATS, COLUMN_TAG_BYTES, FILL_TAG_BYTES, TRIGGER_STATS_FILE_INSERT,
+		TRIGGER_STATS_FILE_UPDATE, TRIGGER_STATS_FILE_DELETE, TRIGGER_STATS_TAG_INSERT,
+		TRIGGER_STATS_TAG_DELETE, TRIGGER_STATS_MATCH_INSERT, TRIGGER_STATS_MATCH_DELETE, NULL },
+	{ COLUMN_FILE_CHECKSUM, NULL },
+};
+
+/* Text of every StatementId */
+static const gchar *statement_sql[SQL_COUNT] =
+{
+	[SQL_BEGIN] = "BEGIN",
+	[SQL_COMMIT] = "COMMIT",
+	[SQL_SAVEPOINT] = "SAVEPOINT import_file",
+	[SQL_RELEASE] = "RELEASE import_file",
+	[SQL_ROLLBACK_TO] = "ROLLBACK TO import_file",
+	[SQL_INSERT_FILE] = "insert into files (fileid, dominant, filename, size,description,checksum) values (NULL,NULL,? ,? ,? ,?)",
+	[SQL_INSERT_MATCH] = "insert into match (tag, fileid) values(?,?)",
+	[SQL_INSERT_TAG] = "insert into tags (name, relpath)  values(?,NULL)",
+	[SQL_INSERT_JOURNAL] = "insert into journal (fileid, source, target) values(?,?,?)",
+	[SQL_DELETE_JOURNAL] = "delete from journal where fileid = ?",
+	[SQL_DELETE_MATCHES] = "delete from match where fileid = ?",
+	[SQL_FILE_TAGS] = "select tag from match where fileid = ?",
+	[SQL_DELETE_FILE] = "delete from files where fileid = ?",
+	[SQL_JOURNAL] = "select fileid,source,target from journal",
+	[SQL_TAG_COUNTS] = "select name,count from tags",
+	[SQL_POPULAR_TAGS] = "select name,count from tags where count > 0 order by count desc",
+	[SQL_LARGEST_TAGS] = "select name,bytes from tags where count > 0 order by bytes desc limit ?",
+	[SQL_STATS] = "select name,value from stats",
+	[SQL_SEARCH] = "select files.filename,files.size from search,files where search match ? and files.fileid = search.rowid order by search.rank",
+	[SQL_FILENAME] = "select filename from files where fileid = ?",
+	[SQL_ALL_FILES] = "select fileid from files order by fileid",
+	[SQL_TAG_FILES] = "select tag,fileid from match order by tag,fileid",
+	[SQL_LAST_ROWS] = "select (select ifnull(max(fileid),0) from files),(select ifnull(max(rowid),0) from match)",
+};
+
+static int schema_version(sqlite3 *db)
+{
+	sqlite3_stmt *statement = NULL;
+	int version = 0;
+
+	if(sqlite3_prepare_v2(db,"PRAGMA user_version",-1,&statement,NULL) != SQLITE_OK) return 0;
+	if(sqlite3_step(statement) == SQLITE_ROW)
+		version = sqlite3_column_int(statement,0);
+	sqlite3_finalize(statement);
+	return version;
+}
+
+/*
+ * Brings the database to SCHEMA_VERSION. Every step runs in its
+ * own transaction together with the new user_version, so an
+ * interrupted upgrade simply runs again.
+ */
+static void migrate(app_state *as)
+{
+	int version = schema_version(as->db);
+	int i;
+
+	if(version > SCHEMA_VERSION)
+	{
+		g_critical("The vault at %s was made by a newer vault (schema %d)\n",as->vault_path,version);
+		exit(1);
+	}
+	for(;version < SCHEMA_VERSION;version++)
+	{
+		gchar *pragma = g_strdup_printf("PRAGMA user_version=%d",version + 1);
+
+		if(as->debug_mode) g_debug("Upgrading schema to version %d\n",version + 1);
+		create_table(as->db,"BEGIN");
+		for(i = 0;migrations[version][i] != NULL;i++)
+			create_table(as->db,(gchar *)migrations[version][i]);
+		create_table(as->db,pragma);
+		create_table(as->db,"COMMIT");
+		g_free(pragma);
+	}
+}
+
 /* Create a new database */
 void dbfs_create(app_state *as)
 {
@@ -88,6 +175,9 @@ void dbfs_create(app_state *as)
 	if(as->debug_mode) g_debug("SQL:%s\n",sql);
 	create_table(as->db,&sql[0]);
 
+	/* Later changes are applied like for any old database */
+	migrate(as);
+
 	sqlite3_close(as->db);
 }
 
@@ -95,6 +185,7 @@ void dbfs_create(app_state *as)
 int dbfs_init(app_state *as)
 {
 	int rc; 
+	int i;
 	if(as->debug_mode) g_debug("Opening database at %s\n",as->db_path);
 
 	rc = sqlite3_open_v2(as->db_path,&as->db,SQLITE_OPEN_READWRITE, NULL);
@@ -103,11 +194,87 @@ int dbfs_init(app_state *as)
 		g_critical("Could not open database!");
 		exit(1);
 	}
+	/*
+	 * Readers no longer block the writer and a commit is an append
+	 * to the log instead of a rewrite of the database pages. Every
+	 * commit is still synced: with NORMAL a power loss can roll back
+	 * an import whose files were already moved.
+	 */
+	create_table(as->db,"PRAGMA journal_mode=WAL");
+	create_table(as->db,"PRAGMA synchronous=FULL");
+
+	/* Older vaults are upgraded in place */
+	migrate(as);
+
+	/* Only now do all tables exist */
+	as->statements = g_new0(sqlite3_stmt *,SQL_COUNT);
+	for(i = 0;i < SQL_COUNT;i++)
+	{
+		if(sqlite3_prepare_v2(as->db,statement_sql[i],-1,&as->statements[i],NULL) != SQLITE_OK)
+		{
+			g_critical("SQL error in %s: %s\n",statement_sql[i],sqlite3_errmsg(as->db));
+			exit(1);
+		}
+	}
+	return rc;
 }
 /* Disconnect from the database */
 void dbfs_shutdown(app_state *as)
 {
+	int i;
+
 	if(as->debug_mode) g_debug("Closing database at %s\n",as->db_path);
+	if(as->tag_counts != NULL) g_hash_table_destroy(as->tag_counts);
+	as->tag_counts = NULL;
+	/* The database cannot close while statements are left */
+	for(i = 0;as->statements != NULL && i < SQL_COUNT;i++)
+		sqlite3_finalize(as->statements[i]);
+	g_free(as->statements);
+	as->statements = NULL;
 	sqlite3_close(as->db);
 }
 
+gboolean dbfs_lock(app_state *as,gboolean wait)
+{
+	gchar *path = NULL;
+	int rc;
+
+	if(as->lock_fd >= 0) return TRUE;
+	path = g_build_filename(as->vault_path,LOCK_NAME,NULL);
+	as->lock_fd = open(path,O_RDWR | O_CREAT | O_CLOEXEC,0600);
+	if(as->lock_fd < 0)
+	{
+		g_critical("Could not open %s: %s",path,g_strerror(errno));
+		exit(1);
+	}
+	g_free(path);
+
+	/* A crashed vault releases it with its descriptors */
+	do rc = flock(as->lock_fd,wait ? LOCK_EX : LOCK_EX | LOCK_NB);
+	while(rc != 0 && errno == EINTR);
+	if(rc != 0)
+	{
+		if(errno != EWOULDBLOCK) g_warning("Could not lock the vault: %s",g_strerror(errno));
+		close(as->lock_fd);
+		as->lock_fd = -1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void dbfs_unlock(app_state *as)
+{
+	if(as->lock_fd < 0) return;
+	close(as->lock_fd);
+	as->lock_fd = -1;
+}
+
+sqlite3_stmt *dbfs_statement(app_state *as,StatementId id)
+{
+	sqlite3_stmt *statement = as->statements[id];
+
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+	return statement;
+}
+
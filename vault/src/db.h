@@ -21,6 +21,38 @@
 #ifndef DB_H
 #define DB_H
 
+/*
+ * Every statement the vault runs. They are prepared once by
+ * dbfs_init() and finalized by dbfs_shutdown().
+ */
+typedef enum
+{
+	SQL_BEGIN,
+	SQL_COMMIT,
+	SQL_SAVEPOINT,
+	SQL_RELEASE,
+	SQL_ROLLBACK_TO,
+	SQL_INSERT_FILE,
+	SQL_INSERT_MATCH,
+	SQL_INSERT_TAG,
+	SQL_INSERT_JOURNAL,
+	SQL_DELETE_JOURNAL,
+	SQL_DELETE_MATCHES,
+	SQL_FILE_TAGS,
+	SQL_DELETE_FILE,
+	SQL_JOURNAL,
+	SQL_TAG_COUNTS,
+	SQL_POPULAR_TAGS,
+	SQL_LARGEST_TAGS,
+	SQL_STATS,
+	SQL_SEARCH,
+	SQL_FILENAME,
+	SQL_ALL_FILES,
+	SQL_TAG_FILES,
+	SQL_LAST_ROWS,
+	SQL_COUNT
+}StatementId;
+
 /* Check if a database is present */
 gboolean dbfs_exists(app_state *as);
 
@@ -32,4 +64,16 @@ int dbfs_init(app_state *as);
 /* Disconnect from the database */
 void dbfs_shutdown(app_state *as);
 
+/*
+ * Takes the import lock. Imports hold it until all their moves are
+ * done, so the journal belongs to nobody else while it is held.
+ * Without wait FALSE is returned if another vault has it.
+ */
+gboolean dbfs_lock(app_state *as,gboolean wait);
+/* Releases the import lock, if held */
+void dbfs_unlock(app_state *as);
+
+/* A prepared statement, reset and without values bound */
+sqlite3_stmt *dbfs_statement(app_state *as,StatementId id);
+
 #endif
@@ -18,76 +18,448 @@
  * Vault -- The storage component of Project Elevate.
 */
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <sqlite3.h>
 #include "vault.h"
+#include "db.h"
+#include "bitmap.h"
+#include "tagindex.h"
+#include "pipeline.h"
+#include "move.h"
 #include "logic.h"
 
 #define DELIM ","
-#define MAX_TAGS 10
 
 /* More files than this have their own directory */
 #define CATEGORY_LIMIT 2
 
-static gchar *index_file(app_state *as,const gchar *filename,gchar **tags);
+/* Files imported in one transaction */
+#define IMPORT_BATCH 1000
+
+/* Tags shown with their disk usage by vault --numbers */
+#define STATS_TOP_TAGS 10
+
+/* Seconds between progress reports of an import */
+#define IMPORT_PROGRESS 5.0
+
+/* Progress of an import */
+typedef struct import_state
+{
+	Pipeline *pipeline;
+	GPtrArray *batch; /* ImportItem journalled in this transaction */
+	GQueue *committed; /* ImportItem committed but not given to the movers yet */
+	GHashTable *targets; /* Target -> ImportItem, for files not moved yet */
+	GPtrArray *new_tags; /* Tags inserted since the savepoint of the file */
+	GTimer *timer; /* NULL for no progress reports */
+	gdouble reported;
+	gint64 bytes; /* Moved so far */
+	guint imported;
+	guint failed;
+}import_state;
+
+/* A boolean tag query being evaluated */
+typedef struct query_state
+{
+	TagIndex *index;
+	gchar **tokens;
+	guint position;
+	gboolean failed;
+}query_state;
+
+static void import_files(app_state *as,Pipeline *pipeline,gchar *keywords);
+static gboolean import_begin(app_state *as,import_state *is,Pipeline *pipeline);
+static void import_one(app_state *as,import_state *is,ImportItem *item,gchar **tags);
+static void import_end(app_state *as,import_state *is);
+static gboolean finish_batch(app_state *as,import_state *is);
+static void hand_over(app_state *as,import_state *is,gboolean wait);
+static void collect_moves(app_state *as,import_state *is,gboolean wait);
+static void finish_move(app_state *as,import_state *is,ImportItem *item);
+static void forget_file(app_state *as,import_state *is,sqlite3_int64 fileid,gboolean remove);
+static void report_progress(import_state *is);
+static gboolean run_statement(app_state *as,StatementId id);
+static gchar *index_file(app_state *as,import_state *is,const gchar *filename,ImportItem *item,gchar **tags);
 static gint tag_count_compare(gconstpointer item1, gconstpointer item2);
+static GHashTable *tag_counts(app_state *as);
 static gboolean tag_path_exists(app_state *as,gchar *tag_path);
-static void insert_new_tag(app_state *as,gchar *tag);
-static int insert_if_new(app_state *as,char *tag);
-static gboolean store_file(app_state *as,gchar *filename,gchar *vault_path);
+static gboolean insert_new_tag(app_state *as,import_state *is,gchar *tag);
+static int insert_if_new(app_state *as,import_state *is,char *tag);
 static const gchar *find_basename(gchar *filename);
 static void create_category(app_state *as,gchar *tag_path); 
 static gchar *replace(gchar *string,const gchar *separator,const gchar *replacement);
+static gchar **query_tokens(const gchar *expression);
+static Bitmap *parse_or(query_state *qs);
+static Bitmap *parse_and(query_state *qs);
+static Bitmap *parse_term(query_state *qs);
+static gboolean next_is(query_state *qs,const gchar *token);
 
 /*
  * In order to import a file we need to perform
  * two major operations.
  * 1. Insert it into the database
  * 2. Move it physically into the vault directory
+ *
+ * Files are imported in batches of IMPORT_BATCH files. Every
+ * file is inserted together with a journal entry that says
+ * where it should be moved, and the batch is committed. Only
+ * then are the files moved, and each move removes its journal
+ * entry. A file that cannot be moved is removed again from the
+ * database.
+ *
+ * The work is split in stages (see pipeline.h). Other threads
+ * find the files, stat them and move them, while this one only
+ * writes the database. Committed files are handed to the movers
+ * a few at a time between inserts, so the next batch is inserted
+ * while the files of the previous one are still being copied.
+ *
+ * If the vault crashes half-way the journal shows which moves
+ * did not happen. logic_recover() finishes them (or forgets the
+ * files) before anything else is done with the vault. An import
+ * holds the import lock (see dbfs_lock) until its moves are done,
+ * so the journal of a running import is never replayed.
+ */
+void logic_import_files(app_state *as,gchar **filenames,gchar *keywords)
+{
+	import_files(as,create_Pipeline(as,filenames,NULL),keywords);
+}
+
+/* Imports every file under dirname. Sub-directories are not imported themselves */
+void logic_import_dir(app_state *as,gchar *dirname,gchar *keywords)
+{
+	if(g_file_test(dirname,G_FILE_TEST_IS_DIR) == FALSE)
+	{
+		g_print("%s: Not a directory\n",dirname);
+		return;
+	}
+	import_files(as,create_Pipeline(as,NULL,dirname),keywords);
+}
+
+/*
+ * Finishes the moves left in the journal by an interrupted import.
+ * A file already in the vault is kept, a file still at its source
+ * is moved and a file found nowhere is removed from the database.
  */
-void logic_import_file(app_state *as,gchar *filename,gchar *keywords)
+void logic_recover(app_state *as)
 {
+	import_state is;
+	sqlite3_stmt *statement = NULL;
+	GPtrArray *moves = NULL;
+	guint i;
+
+	statement = dbfs_statement(as,SQL_JOURNAL);
+	moves = g_ptr_array_new();
+	while(sqlite3_step(statement) == SQLITE_ROW)
+	{
+		ImportItem *item = g_new0(ImportItem,1);
+		item->fileid = sqlite3_column_int64(statement,0);
+		item->source = g_strdup((const gchar *)sqlite3_column_text(statement,1));
+		item->target = g_strdup((const gchar *)sqlite3_column_text(statement,2));
+		g_ptr_array_add(moves,item);
+	}
+	sqlite3_reset(statement);
+
+	if(moves->len > 0 && import_begin(as,&is,create_Pipeline(as,NULL,NULL)))
+	{
+		g_print("Recovering %d interrupted imports\n",moves->len);
+		for(i = 0;i < moves->len;i++)
+		{
+			ImportItem *item = g_ptr_array_index(moves,i);
+			/* Copies the crash did not finish */
+			move_cleanup(item->target);
+			g_hash_table_insert(is.targets,item->target,item);
+			g_queue_push_tail(is.committed,item);
+		}
+		import_end(as,&is);
+	}
+	else
+		g_ptr_array_foreach(moves,(GFunc)free_ImportItem,NULL);
+	g_ptr_array_free(moves,TRUE);
+}
+
+static void import_files(app_state *as,Pipeline *pipeline,gchar *keywords)
+{
+	import_state is;
+	ImportItem *item = NULL;
 	gchar **tags = NULL;
-	gchar *target = NULL;
-	gboolean stored_OK = FALSE;
-	const gchar *basename = NULL;
+	GTimer *timer = NULL;
 
-	if(as->debug_mode) g_debug("Decide what to do\n");
+	if(import_begin(as,&is,pipeline) == FALSE) return;
 
-	/* Before doing anything check that this file 
-	 * actually exists. It can also be a directory
-	 */
-	if(g_file_test(filename,G_FILE_TEST_EXISTS) == FALSE)
+	timer = g_timer_new();
+	is.timer = timer;
+	tags = g_strsplit(keywords,DELIM,-1);
+	while((item = pipeline_next(pipeline)) != NULL)
 	{
-		g_print("%s: No such file or directory\n",filename);
+		import_one(as,&is,item,tags);
+		collect_moves(as,&is,FALSE);
+		hand_over(as,&is,FALSE);
+		report_progress(&is);
+		if(is.batch->len >= IMPORT_BATCH && finish_batch(as,&is) == FALSE) break;
+	}
+	g_strfreev(tags);
+	import_end(as,&is);
+
+	g_print("Imported %d files (%d failed) in %.1f seconds\n",is.imported,is.failed,g_timer_elapsed(timer,NULL));
+	g_timer_destroy(timer);
+}
+
+/* Takes over the pipeline, also when it fails */
+static gboolean import_begin(app_state *as,import_state *is,Pipeline *pipeline)
+{
+	memset(is,0,sizeof(import_state));
+	is->pipeline = pipeline;
+	is->batch = g_ptr_array_new();
+	is->committed = g_queue_new();
+	is->targets = g_hash_table_new(g_str_hash,g_str_equal);
+	is->new_tags = g_ptr_array_new();
+
+	if(run_statement(as,SQL_BEGIN) == FALSE)
+	{
+		import_end(as,is);
+		return FALSE;
+	}
+	/* The tag index is rebuilt by the next query */
+	tagindex_invalidate(as);
+	return TRUE;
+}
+
+/* Puts the file and its journal entry in the database */
+static void import_one(app_state *as,import_state *is,ImportItem *item,gchar **tags)
+{
+	gchar *relative = NULL;
+	const gchar *basename = NULL;
+	sqlite3_stmt *statement = NULL;
+	int i;
+
+	/* It could not be read */
+	if(item->ok == FALSE)
+	{
+		is->failed++;
+		free_ImportItem(item);
 		return; 
 	}
-	basename = find_basename(filename);
+	basename = find_basename(item->source);
+	run_statement(as,SQL_SAVEPOINT);
+
 	/*
 	 * Insert the file into the database.
 	 * This function returns the relative path
 	 * inside the vault where the physical file
 	 * should be moved.
 	 */
-	tags = g_strsplit(keywords,DELIM,MAX_TAGS);
-	target = index_file(as,basename,tags);
-	g_strfreev(tags); 
+	relative = index_file(as,is,basename,item,tags);
+	if(relative == NULL) 
+	{
+		g_print("%s: Could not index file: %s\n",item->source,sqlite3_errmsg(as->db));
+		goto failed;
+	}
+	item->target = g_build_filename(as->store_path,relative,basename,NULL);
+	g_free(relative);
 
-	/* Finally move the actual file into the vault */
-	if(target == NULL) 
+	/* Two files of this import may want the same place */
+	if(g_hash_table_lookup(is->targets,item->target) != NULL || g_file_test(item->target,G_FILE_TEST_EXISTS))
 	{
-		g_error("Could not index file %s\n",filename);
-		return;
+		g_print("%s: Already in the vault\n",item->target);
+		goto failed;
 	}
-	stored_OK = store_file(as,filename,target);
-	if(stored_OK == FALSE) 
+
+	/* The journal entry commits together with the file */
+	statement = dbfs_statement(as,SQL_INSERT_JOURNAL);
+	sqlite3_bind_int64(statement,1,item->fileid);
+	sqlite3_bind_text(statement,2,item->source,-1,SQLITE_STATIC);
+	sqlite3_bind_text(statement,3,item->target,-1,SQLITE_STATIC);
+	if(sqlite3_step(statement) != SQLITE_DONE)
 	{
-		g_error("Could not move file %s into the vault\n",filename);
-		return;
+		g_print("%s: Could not journal file: %s\n",item->source,sqlite3_errmsg(as->db));
+		goto failed;
+	}
+	run_statement(as,SQL_RELEASE);
+	g_hash_table_insert(is->targets,item->target,item);
+	g_ptr_array_add(is->batch,item);
+	g_ptr_array_foreach(is->new_tags,(GFunc)g_free,NULL);
+	g_ptr_array_set_size(is->new_tags,0);
+
+	/* Only now are the matches really in the database */
+	for(i = 0; tags[i] != NULL;i++)
+	{
+		gpointer count = NULL;
+		gpointer key = NULL;
+		if(g_hash_table_lookup_extended(tag_counts(as),tags[i],&key,&count))
+			g_hash_table_insert(as->tag_counts,g_strdup(tags[i]),GINT_TO_POINTER(GPOINTER_TO_INT(count) + 1));
+	}
+	return;
+
+failed:
+	run_statement(as,SQL_ROLLBACK_TO);
+	run_statement(as,SQL_RELEASE);
+	/* New tags of the file are gone again, the counts were not raised yet */
+	for(i = 0;i < is->new_tags->len;i++)
+	{
+		g_hash_table_remove(as->tag_counts,g_ptr_array_index(is->new_tags,i));
+		g_free(g_ptr_array_index(is->new_tags,i));
+	}
+	g_ptr_array_set_size(is->new_tags,0);
+	is->failed++;
+	free_ImportItem(item);
+}
+
+/*
+ * Commits the batch, which makes the journal durable. Its files go
+ * to the movers while the next batch is inserted, and their journal
+ * entries are removed in the next transactions as the moves finish.
+ * The previous batch has to be handed over first, so at most two
+ * batches wait for the movers.
+ */
+static gboolean finish_batch(app_state *as,import_state *is)
+{
+	guint i;
+
+	hand_over(as,is,TRUE);
+	if(run_statement(as,SQL_COMMIT) == FALSE) return FALSE;
+
+	for(i = 0;i < is->batch->len;i++)
+		g_queue_push_tail(is->committed,g_ptr_array_index(is->batch,i));
+	g_ptr_array_set_size(is->batch,0);
+
+	if(run_statement(as,SQL_BEGIN) == FALSE) return FALSE;
+	hand_over(as,is,FALSE);
+	return TRUE;
+}
+
+/* Gives committed files to the movers. With wait until all are given */
+static void hand_over(app_state *as,import_state *is,gboolean wait)
+{
+	while(!g_queue_is_empty(is->committed))
+	{
+		ImportItem *item = NULL;
+
+		if(pipeline_move(is->pipeline,g_queue_peek_head(is->committed)))
+		{
+			g_queue_pop_head(is->committed);
+			continue;
+		}
+		if(!wait) return;
+
+		/* The movers are busy, a finished move makes room */
+		item = pipeline_moved(is->pipeline,TRUE);
+		if(item == NULL) return;
+		finish_move(as,is,item);
+		report_progress(is);
+	}
+}
+
+/* Handles finished moves. With wait until every move is done */
+static void collect_moves(app_state *as,import_state *is,gboolean wait)
+{
+	ImportItem *item = NULL;
+
+	while((item = pipeline_moved(is->pipeline,wait)) != NULL)
+	{
+		finish_move(as,is,item);
+		report_progress(is);
+	}
+}
+
+static void finish_move(app_state *as,import_state *is,ImportItem *item)
+{
+	g_hash_table_remove(is->targets,item->target);
+	if(item->ok)
+	{
+		forget_file(as,is,item->fileid,FALSE);
+		is->imported++;
+		is->bytes += item->size;
+	}
+	else
+	{
+		g_print("%s: Could not move file into the vault\n",item->source);
+		forget_file(as,is,item->fileid,TRUE);
+		is->failed++;
+	}
+	free_ImportItem(item);
+}
+
+/* Removes the journal entry and, if remove is set, the file itself */
+static void forget_file(app_state *as,import_state *is,sqlite3_int64 fileid,gboolean remove)
+{
+	StatementId statements[] = {SQL_DELETE_JOURNAL,SQL_DELETE_MATCHES,SQL_DELETE_FILE};
+	int count = remove ? 3 : 1;
+	int i;
+
+	/* The matches go, so the counts of their tags go down */
+	if(remove && as->tag_counts != NULL)
+	{
+		sqlite3_stmt *statement = dbfs_statement(as,SQL_FILE_TAGS);
+		sqlite3_bind_int64(statement,1,fileid);
+		while(sqlite3_step(statement) == SQLITE_ROW)
+		{
+			const gchar *tag = (const gchar *)sqlite3_column_text(statement,0);
+			gpointer files = NULL;
+			if(tag != NULL && g_hash_table_lookup_extended(as->tag_counts,tag,NULL,&files))
+				g_hash_table_insert(as->tag_counts,g_strdup(tag),GINT_TO_POINTER(GPOINTER_TO_INT(files) - 1));
+		}
+		sqlite3_reset(statement);
+	}
+
+	for(i = 0;i < count;i++)
+	{
+		sqlite3_stmt *statement = dbfs_statement(as,statements[i]);
+		sqlite3_bind_int64(statement,1,fileid);
+		if(sqlite3_step(statement) != SQLITE_DONE)
+			g_warning("Could not update the journal: %s",sqlite3_errmsg(as->db));
 	}
+}
+
+/* Large imports say how they are doing every IMPORT_PROGRESS seconds */
+static void report_progress(import_state *is)
+{
+	gdouble elapsed;
+
+	if(is->timer == NULL) return;
+	elapsed = g_timer_elapsed(is->timer,NULL);
+	if(elapsed - is->reported < IMPORT_PROGRESS) return;
+	is->reported = elapsed;
 
+	g_print("%d of %d files imported (%d failed), %.0f files/s, %.1f MB/s\n",
+			is->imported,pipeline_found(is->pipeline),is->failed,
+			is->imported / elapsed,is->bytes / elapsed / 1000.0 / 1000.0);
+}
+
+static void import_end(app_state *as,import_state *is)
+{
+	if(is->batch->len > 0) finish_batch(as,is);
+	hand_over(as,is,TRUE);
+	pipeline_moves_done(is->pipeline);
+	collect_moves(as,is,TRUE);
+	if(sqlite3_get_autocommit(as->db) == 0) run_statement(as,SQL_COMMIT);
+	/* A query during the import may have built it half way */
+	tagindex_invalidate(as);
+
+	/* Left over only if the batch could not be committed */
+	is->failed += is->batch->len;
+	g_ptr_array_foreach(is->batch,(GFunc)free_ImportItem,NULL);
+	g_ptr_array_free(is->batch,TRUE);
+	g_queue_free(is->committed);
+	g_hash_table_destroy(is->targets);
+	g_ptr_array_free(is->new_tags,TRUE);
+	free_Pipeline(is->pipeline);
+}
+
+/* Runs a statement that returns no rows */
+static gboolean run_statement(app_state *as,StatementId id)
+{
+	sqlite3_stmt *statement = dbfs_statement(as,id);
+
+	if(sqlite3_step(statement) != SQLITE_DONE)
+	{
+		g_warning("SQL error in %s: %s",sqlite3_sql(statement),sqlite3_errmsg(as->db));
+		sqlite3_reset(statement);
+		return FALSE;
+	}
+	sqlite3_reset(statement);
+	return TRUE;
 }
 
 /*
@@ -136,47 +508,40 @@ struct popularity
 };
 
 
-static gchar *index_file(app_state *as,const gchar *filename,gchar **tags)
+/* Returns the directory (relative to the store) for the file */
+static gchar *index_file(app_state *as,import_state *is,const gchar *filename,ImportItem *item,gchar **tags)
 {
 	int rc; 
-	gchar sql[300];
 	sqlite3_stmt *statement = NULL;
 	unsigned long long last; /* Primary key of the file inserted */
-	int popular=0;
-	gchar *dominant=NULL;
 	int i;
-	struct stat fileInfo;
-	unsigned long file_size = 0;
 	GSList* tag_tree = NULL;
 	GSList* iterator = NULL;
 	GSList* tag_paths = NULL;
 	struct popularity *current = NULL;
-
-	rc = g_stat(filename,&fileInfo);
-	if(rc != -1) file_size = fileInfo.st_size;
+	gchar *dominant = NULL;
+	gchar *result = NULL;
 
 	/* In order to get its id
 	 * we need to put the file into the database first 
 	 */
 	if(as->debug_mode) g_debug("We have %d tags for file %s\n",g_strv_length (tags),filename);
 
-	g_snprintf(sql,300,"%s","insert into files (fileid, dominant, filename, size,description) values (NULL,NULL,? ,? ,?)");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc != SQLITE_OK) return NULL;
-
+	statement = dbfs_statement(as,SQL_INSERT_FILE);
 	rc = sqlite3_bind_text(statement,1,filename,-1,SQLITE_STATIC);
 	if(rc != SQLITE_OK) return NULL;
-	rc = sqlite3_bind_int(statement,2,file_size);
+	rc = sqlite3_bind_int64(statement,2,item->size);
 	if(rc != SQLITE_OK) return NULL;
 	rc = sqlite3_bind_text(statement,3,"Unused",-1,SQLITE_STATIC);
 	if(rc != SQLITE_OK) return NULL;
+	rc = sqlite3_bind_text(statement,4,item->checksum,-1,SQLITE_STATIC);
+	if(rc != SQLITE_OK) return NULL;
 
 	rc = sqlite3_step(statement);
 	if(rc != SQLITE_DONE) return NULL;
 
-	sqlite3_finalize(statement);
-
 	last = sqlite3_last_insert_rowid(as->db);
+	item->fileid = last;
 	//if(as->debug_mode) g_debug("Last file id was  %d\n",last);
 
 	/* Now that we have the id of the inserted
@@ -198,20 +563,17 @@ static gchar *index_file(app_state *as,const gchar *filename,gchar **tags)
 		gchar *tag = tags[i];
 		/* See how popular this tag is */
 		/* This is step 1 */
-		count = insert_if_new(as,tag);
+		count = insert_if_new(as,is,tag);
+		if(count < 0) goto out;
 		if(as->debug_mode) g_debug("Tag %s has %d matches\n",tag,count);
-		g_snprintf(sql,300,"%s","insert into match (tag, fileid) values(?,?)");
-		rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-		if(rc != SQLITE_OK) return NULL;
 
+		statement = dbfs_statement(as,SQL_INSERT_MATCH);
 		rc = sqlite3_bind_text(statement,1,tag,-1,SQLITE_STATIC);
-		if(rc != SQLITE_OK) return NULL;
+		if(rc != SQLITE_OK) goto out;
 		rc = sqlite3_bind_double(statement,2,last);
-		if(rc != SQLITE_OK) return NULL;
+		if(rc != SQLITE_OK) goto out;
 		rc = sqlite3_step(statement);
-		if(rc != SQLITE_DONE) return NULL;
-
-		sqlite3_finalize(statement);
+		if(rc != SQLITE_DONE) goto out;
 
 		current = g_new0(struct popularity,1);
 		current->count = count;
@@ -224,43 +586,47 @@ static gchar *index_file(app_state *as,const gchar *filename,gchar **tags)
 	for(iterator = tag_tree;iterator;iterator = iterator->next)
 	{
 		struct popularity *now = iterator ->data;
+		gchar *longer = g_strconcat(dominant,"_",now->tag,NULL);
 		g_debug("We have %s with count %d",now->tag,now->count);
-		dominant = g_strconcat(dominant,"_",now->tag,NULL);
-		now->tag = dominant;
+		g_free(dominant);
+		dominant = longer;
+		now->tag = g_strdup(dominant + 1); //Without the leading underscore
 		tag_paths = g_slist_prepend(tag_paths,now);
 	}
+	g_free(dominant);
 	//Find dominant tag. This is step 3
 	for(iterator = tag_paths;iterator;iterator = iterator->next)
 	{
-		gboolean found = FALSE;
 		current = iterator ->data;
-		//Remove the leading undescore created in step 2
-		current->tag++;
 		g_debug("Tag tree %s and count %d",current->tag,current->count);
-		found = tag_path_exists(as,current->tag);
-		if(found) break;
-		dominant = current->tag;
+		if(tag_path_exists(as,current->tag)) break;
 	}
 	//Step 4
-	if(current->count < CATEGORY_LIMIT)
+	if(current == NULL)
+	{
+		g_debug("No tags, the file goes in the root of the vault");
+		result = g_strdup("");
+	}
+	else if(current->count < CATEGORY_LIMIT)
 	{
 		g_debug("Normal case since count is %d for %s",current->count,current->tag);
-		return "";
+		result = g_strdup("");
 	}
 	else
 	{
 		g_debug("Boundary case since count is %d for %s",current->count,current->tag);
 		create_category(as,current->tag);
-		return replace(current->tag,"_","/");
+		result = replace(current->tag,"_","/");
 	}
-
-	
-	//Since we are here we know the final tag
-	
 	//update_dominant_tag(as,last,dominant); TODO
 
-	/* Just for now we return the root directory of the vault */
-	//return "";
+	for(iterator = tag_paths;iterator;iterator = iterator->next)
+		g_free(((struct popularity *)iterator->data)->tag);
+out:
+	g_slist_foreach(tag_tree,(GFunc)g_free,NULL);
+	g_slist_free(tag_tree);
+	g_slist_free(tag_paths);
+	return result;
 }
 static gint tag_count_compare(gconstpointer item1, gconstpointer item2)
 {
@@ -272,83 +638,63 @@ static gint tag_count_compare(gconstpointer item1, gconstpointer item2)
 	else return 0;
 }
 
-static gboolean tag_path_exists(app_state *as,gchar *tag_path)
+/*
+ * Files of every tag, read from the tags table once per run and
+ * then kept up to date by the import. Lookups during an import
+ * never go to the database.
+ */
+static GHashTable *tag_counts(app_state *as)
 {
-	int rc;
-	gchar sql[300];
 	sqlite3_stmt *statement = NULL;
-	gboolean found = FALSE;
-	/* check if the tag exists */
-	g_snprintf(sql,300,"%s","select name from tags where name = ?");
 
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc != SQLITE_OK) return -1;
+	if(as->tag_counts != NULL) return as->tag_counts;
 
-	rc = sqlite3_bind_text(statement,1,tag_path,-1,SQLITE_STATIC);
-	if(rc != SQLITE_OK) return -1;
+	as->tag_counts = g_hash_table_new_full(g_str_hash,g_str_equal,g_free,NULL);
+	statement = dbfs_statement(as,SQL_TAG_COUNTS);
+	while(sqlite3_step(statement) == SQLITE_ROW)
+	{
+		const gchar *name = (const gchar *)sqlite3_column_text(statement,0);
+		if(name != NULL)
+			g_hash_table_insert(as->tag_counts,g_strdup(name),GINT_TO_POINTER(sqlite3_column_int(statement,1)));
+	}
+	sqlite3_reset(statement);
+	if(as->debug_mode) g_debug("Loaded %d tags\n",g_hash_table_size(as->tag_counts));
+	return as->tag_counts;
+}
 
-	rc = sqlite3_step(statement);
-	/* If a row is returned then the tag exists */
-	if(rc ==  SQLITE_ROW) found = TRUE;
-	sqlite3_finalize(statement);
+/* The database changed behind the cache. It is loaded again when needed */
 
-	return found;
+static gboolean tag_path_exists(app_state *as,gchar *tag_path)
+{
+	return g_hash_table_lookup_extended(tag_counts(as),tag_path,NULL,NULL);
 }
-/* Put a new tag in the tags table of the database */
-static int insert_if_new(app_state *as,gchar *tag)
+/*
+ * Put a new tag in the tags table of the database. Returns how
+ * many files have the tag or -1 on error.
+ */
+static int insert_if_new(app_state *as,import_state *is,gchar *tag)
 {
-	int rc;
-	gchar sql[300];
-	sqlite3_stmt *statement = NULL;
-	gboolean found = FALSE;
-
-	found = tag_path_exists(as,tag);
-
-	if(found == TRUE )
-	{
-		int count = 0 ;
-		if(as->debug_mode) g_debug("Tag %s already exists\n",tag);
+	gpointer count = NULL;
 
+	if(g_hash_table_lookup_extended(tag_counts(as),tag,NULL,&count))
+		return GPOINTER_TO_INT(count);
 
-		g_snprintf(sql,300,"%s","select count(*) from match where tag = ?");
-
-		rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-		if(rc != SQLITE_OK) return -1;
-
-		rc = sqlite3_bind_text(statement,1,tag,-1,SQLITE_STATIC);
-		if(rc != SQLITE_OK) return -1;
-
-		rc = sqlite3_step(statement);
-		/* If a row is returned then the tag exists */
-		if(rc !=  SQLITE_ROW) return 0; /* Should never happen normally */;
-		count = sqlite3_column_int(statement,0);
-		sqlite3_finalize(statement);
-
-		return count;
-	}
-	insert_new_tag(as,tag);
+	if(insert_new_tag(as,is,tag) == FALSE) return -1;
+	g_hash_table_insert(as->tag_counts,g_strdup(tag),GINT_TO_POINTER(0));
+	/* Dropped again if the savepoint rolls back */
+	g_ptr_array_add(is->new_tags,g_strdup(tag));
 	return 0; /* Obviously a new tag has no files associated */
 }
 
-static void insert_new_tag(app_state *as,gchar *tag)
+static gboolean insert_new_tag(app_state *as,import_state *is,gchar *tag)
 {
-	int rc;
-	gchar sql[300];
-	sqlite3_stmt *statement = NULL;
+	sqlite3_stmt *statement = dbfs_statement(as,SQL_INSERT_TAG);
 
 	/* Insert this tag */
 	if(as->debug_mode) g_debug("%s is a new tag! Inserting it now\n",tag);
 
-	g_snprintf(sql,300,"%s","insert into tags (name, relpath)  values(?,NULL)");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc != SQLITE_OK) return;
-
-	rc = sqlite3_bind_text(statement,1,tag,-1,SQLITE_STATIC);
-	if(rc != SQLITE_OK) return;
-	rc = sqlite3_step(statement);
-	if(rc != SQLITE_DONE) return;
-
-	sqlite3_finalize(statement);
+	if(sqlite3_bind_text(statement,1,tag,-1,SQLITE_STATIC) != SQLITE_OK) return FALSE;
+	return sqlite3_step(statement) == SQLITE_DONE;
 }
 
 static void create_category(app_state *as,gchar *tag_path)
@@ -362,104 +708,69 @@ static void create_category(app_state *as,gchar *tag_path)
 	
 	
 }
+/*
+ * All numbers come from the stats table and the bytes column of
+ * tags, which triggers keep current. Nothing is counted here.
+ */
 void logic_print_statistics(app_state *as)
 {
-	int rc;
-	gchar sql[300];
 	sqlite3_stmt *statement = NULL;
-	unsigned long total_tags = 0;
-	unsigned long total_files = 0;
-	double total_size = 0;
+	gint64 total_tags = 0;
+	gint64 total_files = 0;
+	gint64 total_matches = 0;
+	gint64 total_size = 0;
 
 	if(as->debug_mode) g_debug("Generating statistics for the database\n");
 	g_print("\nEmbedded database is located: %s\n",as->db_path);
 	g_print("Managed filesystem can be found: %s\n",as->store_path);
 
-	g_snprintf(sql,300,"%s","select count(*) from tags");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc == SQLITE_OK)
+	statement = dbfs_statement(as,SQL_STATS);
+	while(sqlite3_step(statement) == SQLITE_ROW)
 	{
-		rc = sqlite3_step(statement);
-		if(rc ==  SQLITE_ROW) 
-			total_tags = sqlite3_column_int(statement,0);
-	}
-	sqlite3_finalize(statement);
-
-
-	g_snprintf(sql,300,"%s","select count(*) from files");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc == SQLITE_OK)
-	{
-		rc = sqlite3_step(statement);
-		if(rc ==  SQLITE_ROW) 
-			total_files = sqlite3_column_int(statement,0);
-	}
-	sqlite3_finalize(statement);
+		const gchar *name = (const gchar *)sqlite3_column_text(statement,0);
+		gint64 value = sqlite3_column_int64(statement,1);
 
-	g_snprintf(sql,300,"%s","select sum(size) from files");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc == SQLITE_OK)
-	{
-		rc = sqlite3_step(statement);
-		if(rc ==  SQLITE_ROW) 
-			total_size = sqlite3_column_int(statement,0);
+		if(g_strcmp0(name,"tags") == 0) total_tags = value;
+		else if(g_strcmp0(name,"files") == 0) total_files = value;
+		else if(g_strcmp0(name,"matches") == 0) total_matches = value;
+		else if(g_strcmp0(name,"bytes") == 0) total_size = value;
 	}
-	sqlite3_finalize(statement);
-
-	/* Convert bytes to megabytes */
-	total_size = total_size / 1000.0;
-	total_size = total_size / 1000.0;
-
-	g_print("\nTotal number of tags: %ld\n",total_tags);
-	g_print("Total files managed: %ld\n",total_files);
-	g_print("Total database size (MB): %f\n",total_size);
+	sqlite3_reset(statement);
+
+	g_print("\nTotal number of tags: %" G_GINT64_FORMAT "\n",total_tags);
+	g_print("Total files managed: %" G_GINT64_FORMAT "\n",total_files);
+	g_print("Total tags given to files: %" G_GINT64_FORMAT "\n",total_matches);
+	g_print("Total database size (MB): %f\n",total_size / 1000.0 / 1000.0);
+
+	g_print("\nLargest tags (MB):\n");
+	statement = dbfs_statement(as,SQL_LARGEST_TAGS);
+	sqlite3_bind_int(statement,1,STATS_TOP_TAGS);
+	while(sqlite3_step(statement) == SQLITE_ROW)
+		g_print("%s\t\t%f\n",sqlite3_column_text(statement,0),sqlite3_column_int64(statement,1) / 1000.0 / 1000.0);
+	sqlite3_reset(statement);
 }
 
 void logic_print_tags(app_state *as)
 {
 	int rc;
-	gchar sql[300];
 	sqlite3_stmt *statement = NULL;
+	const unsigned char *next_tag = NULL;
+	unsigned long rank = 0;
 
 	if(as->debug_mode) g_debug("Calculating tag popularity\n");
 
 	g_print("Tag\t\tFiles\n");
 
-	g_snprintf(sql,300,"%s","select tag,count(tag) from match group by tag order by count(tag) desc");
-	rc = sqlite3_prepare_v2(as->db,&sql[0],300,&statement,NULL);
-	if(rc == SQLITE_OK)
+	statement = dbfs_statement(as,SQL_POPULAR_TAGS);
+	while(TRUE)
 	{
-		const unsigned char *next_tag = NULL;
-		unsigned long rank = 0;
-		while(TRUE)
-		{
-			rc = sqlite3_step(statement);
-			if(rc !=  SQLITE_ROW) break; 
-			next_tag = sqlite3_column_text(statement,0);
-			rank = sqlite3_column_int(statement,1);
-			g_print("%s\t\t%ld\n",next_tag,rank);
-		}
+		rc = sqlite3_step(statement);
+		if(rc !=  SQLITE_ROW) break; 
+		next_tag = sqlite3_column_text(statement,0);
+		rank = sqlite3_column_int(statement,1);
+		g_print("%s\t\t%ld\n",next_tag,rank);
 	}
-	sqlite3_finalize(statement);
-}
-
-/* Copies a file into the vault.
- * The third argument is a path relative to the vault
- * directory. "" is the root of the vault.
- */
-static gboolean store_file(app_state *as,gchar *filename,gchar *vault_path)
-{
-	const gchar* basename = NULL;
-	gchar targetpath[_POSIX_PATH_MAX];
-	gint moved_OK =-1;
-
-	basename = find_basename(filename);
-	g_snprintf(targetpath,_POSIX_PATH_MAX,"%s/%s/%s",as->store_path,vault_path,basename);
-
-	if(as->debug_mode) g_debug("Moving file %s to  path %s\n",filename,targetpath);
-	moved_OK = g_rename(filename,targetpath);
-	if(moved_OK == 0 ) return TRUE;
-	else return FALSE;
+	sqlite3_reset(statement);
 }
 
 static const gchar *find_basename(gchar *filename)
@@ -483,54 +794,246 @@ static const gchar *find_basename(gchar *filename)
 
 	return basename;
 }
+/*
+ * Searches filenames, descriptions and tags through the full text
+ * index. Keywords are separated with commas and any of them can
+ * match:
+ *
+ *	video		words starting with video (videos, video2008)
+ *	hol*		the same, written explicitly
+ *	"video"		exactly the word video
+ *	summer holiday	the phrase, last word as a prefix
+ *
+ * Best matches (bm25) are printed first.
+ */
 void logic_search(app_state *as,gchar *keywords)
 {
 	int rc;
 	int i;
-	gchar sql[1024]; /* There should be a better way than this FIXME */
 	sqlite3_stmt *statement = NULL;
 	gchar **tags = NULL;
-	const gchar *result = NULL;
+	GString *query = NULL;
+	const unsigned char *result = NULL;
 
 	if(as->debug_mode) g_debug("Searching vault for tag(s) %s\n",keywords);
 
-	tags = g_strsplit(keywords,DELIM,MAX_TAGS);
-	/*
-	 * Unfortunately this SQL commands is of variable size.
-	 * It grows as more tags are entered by the user. We should
-	 * make sure that the buffer holds everything
-	 */
+	tags = g_strsplit(keywords,DELIM,-1);
+	query = g_string_new(NULL);
+	for(i = 0; tags[i] != NULL;i++)
+	{
+		gchar *tag = g_strstrip(tags[i]);
+		gsize length = strlen(tag);
+		gboolean exact = FALSE;
+		const gchar *p = NULL;
 
-	g_snprintf(sql,300,"%s","select distinct filename,size from match,files where match.fileid=files.fileid and (");
-	for(i = 0; i < g_strv_length(tags);i++)
+		if(length == 0) continue;
+		if(length > 1 && tag[0] == '"' && tag[length - 1] == '"')
+		{
+			exact = TRUE;
+			tag[length - 1] = '\0';
+			tag++;
+		}
+		else if(tag[length - 1] == '*') tag[length - 1] = '\0';
+
+		/* Everything is quoted so that no keyword is FTS syntax */
+		if(query->len > 0) g_string_append(query," OR ");
+		g_string_append_c(query,'"');
+		for(p = tag;*p != '\0';p++)
+		{
+			if(*p == '"') g_string_append_c(query,'"');
+			g_string_append_c(query,*p);
+		}
+		g_string_append(query,exact ? "\"" : "\"*");
+	}
+	g_strfreev(tags);
+	if(as->debug_mode) g_debug("Full text query is %s\n",query->str);
+
+	if(query->len == 0)
 	{
-		int position = 0;
-		gchar *tag = tags[i];
-		position = g_strlcat(sql," match.tag LIKE ? or",1024);
+		g_string_free(query,TRUE);
+		return;
 	}
-	g_strlcat(sql," 1=0)",1024);
-	if(as->debug_mode) g_debug("We have %s\n",sql);
-	rc = sqlite3_prepare_v2(as->db,&sql[0],1024,&statement,NULL);
-	if(rc != SQLITE_OK) return ;
-	for(i = 0; i < g_strv_length(tags);i++)
+
+	statement = dbfs_statement(as,SQL_SEARCH);
+	rc = sqlite3_bind_text(statement,1,query->str,-1,SQLITE_STATIC);
+	if(rc == SQLITE_OK)
 	{
-		gchar *tag = tags[i];
-		gchar *tag_string = g_strdup_printf("%%%s%%",tag); /* For the match operator */
-		rc = sqlite3_bind_text(statement,i+1,tag_string,-1,SQLITE_TRANSIENT); /* SQL variables start from 1 */
-		g_free(tag_string);
-		if(rc != SQLITE_OK) break;
+		while((rc = sqlite3_step(statement)) == SQLITE_ROW)
+		{
+			result = sqlite3_column_text(statement,0);
+			g_print("%s/%s\n",as->store_path,result);
+		}
 	}
-	while(TRUE)
+	if(rc != SQLITE_DONE)
+		g_print("Search failed: %s\n",sqlite3_errmsg(as->db));
+	sqlite3_reset(statement);
+	g_string_free(query,TRUE);
+}
+
+/*
+ * Boolean queries over exact tags, answered from the tag index
+ * without touching the match table.
+ *
+ *	video AND 2008 AND NOT trailers
+ *	(holiday OR summer) 2008	words next to each other are ANDed
+ *
+ * Operators are upper case so that tags like "not" still work. NOT
+ * binds tightest, then AND, then OR.
+ */
+void logic_query(app_state *as,gchar *expression)
+{
+	query_state qs;
+	Bitmap *found = NULL;
+	GArray *fileids = NULL;
+	sqlite3_stmt *statement = NULL;
+	guint i;
+
+	if(as->debug_mode) g_debug("Querying vault for %s\n",expression);
+
+	memset(&qs,0,sizeof(qs));
+	qs.index = tagindex_open(as);
+	if(qs.index == NULL)
 	{
-		rc = sqlite3_step(statement);
-		if(rc !=  SQLITE_ROW) break; 
-		result = sqlite3_column_text(statement,0);
-		g_print("%s/%s\n",as->store_path,result);
+		g_print("Could not load the tag index\n");
+		return;
+	}
+	qs.tokens = query_tokens(expression);
+	found = parse_or(&qs);
+	if(qs.tokens[qs.position] != NULL)
+	{
+		g_print("Unexpected %s in query\n",qs.tokens[qs.position]);
+		qs.failed = TRUE;
+	}
+
+	fileids = g_array_new(FALSE,FALSE,sizeof(guint32));
+	if(!qs.failed) bitmap_values(found,fileids);
+	if(as->debug_mode) g_debug("Query matched %d files\n",fileids->len);
+
+	statement = dbfs_statement(as,SQL_FILENAME);
+	for(i = 0;i < fileids->len;i++)
+	{
+		sqlite3_bind_int64(statement,1,g_array_index(fileids,guint32,i));
+		if(sqlite3_step(statement) == SQLITE_ROW)
+			g_print("%s/%s\n",as->store_path,sqlite3_column_text(statement,0));
+		sqlite3_reset(statement);
+	}
+
+	g_array_free(fileids,TRUE);
+	free_Bitmap(found);
+	g_strfreev(qs.tokens);
+	free_TagIndex(qs.index);
+}
+
+/* Splits on white space, parentheses are tokens of their own */
+static gchar **query_tokens(const gchar *expression)
+{
+	GPtrArray *result = g_ptr_array_new();
+	const gchar *p = expression;
+
+	while(*p != '\0')
+	{
+		const gchar *start = p;
+
+		if(g_ascii_isspace(*p))
+		{
+			p++;
+			continue;
+		}
+		if(*p == '(' || *p == ')') p++;
+		else
+			while(*p != '\0' && !g_ascii_isspace(*p) && *p != '(' && *p != ')') p++;
+		g_ptr_array_add(result,g_strndup(start,p - start));
+	}
+	g_ptr_array_add(result,NULL);
+	return (gchar **)g_ptr_array_free(result,FALSE);
+}
+
+static Bitmap *parse_or(query_state *qs)
+{
+	Bitmap *result = parse_and(qs);
+
+	while(next_is(qs,"OR"))
+	{
+		Bitmap *left = result;
+		Bitmap *right = NULL;
+
+		qs->position++;
+		right = parse_and(qs);
+		result = bitmap_or(left,right);
+		free_Bitmap(left);
+		free_Bitmap(right);
+	}
+	return result;
+}
+
+static Bitmap *parse_and(query_state *qs)
+{
+	Bitmap *result = parse_term(qs);
+
+	while(qs->tokens[qs->position] != NULL && !next_is(qs,"OR") && !next_is(qs,")"))
+	{
+		Bitmap *left = result;
+		Bitmap *right = NULL;
+		gboolean negate = FALSE;
+
+		if(next_is(qs,"AND")) qs->position++;
+		/* a AND NOT b is a difference, not an intersection with everything else */
+		if(next_is(qs,"NOT"))
+		{
+			qs->position++;
+			negate = TRUE;
+		}
+		right = parse_term(qs);
+		result = negate ? bitmap_andnot(left,right) : bitmap_and(left,right);
+		free_Bitmap(left);
+		free_Bitmap(right);
 	}
-	sqlite3_finalize(statement);
+	return result;
+}
+
+static Bitmap *parse_term(query_state *qs)
+{
+	const gchar *token = qs->tokens[qs->position];
+	Bitmap *result = NULL;
+
+	if(token == NULL || next_is(qs,")") || next_is(qs,"AND") || next_is(qs,"OR"))
+	{
+		g_print("Missing tag in query\n");
+		qs->failed = TRUE;
+		return create_Bitmap();
+	}
+	qs->position++;
+
+	if(strcmp(token,"NOT") == 0)
+	{
+		Bitmap *operand = parse_term(qs);
+		result = bitmap_andnot(qs->index->all,operand);
+		free_Bitmap(operand);
+	}
+	else if(strcmp(token,"(") == 0)
+	{
+		result = parse_or(qs);
+		if(next_is(qs,")")) qs->position++;
+		else
+		{
+			g_print("Missing ) in query\n");
+			qs->failed = TRUE;
+		}
+	}
+	else
+		result = tagindex_lookup(qs->index,token);
+	return result;
+}
+
+static gboolean next_is(query_state *qs,const gchar *token)
+{
+	return g_strcmp0(qs->tokens[qs->position],token) == 0;
 }
 
 static gchar *replace(gchar *string,const gchar *separator,const gchar *replacement)
 {
-	 return g_strjoinv(replacement, g_strsplit(string, separator, -1)); 
+	gchar **parts = g_strsplit(string, separator, -1);
+	gchar *result = g_strjoinv(replacement, parts);
+	g_strfreev(parts);
+	return result;
 }
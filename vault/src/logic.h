@@ -27,9 +27,18 @@ void logic_print_statistics(app_state *as);
 /* Show existing tags */
 void logic_print_tags(app_state *as);
 
-/* Index a file in the database */
-void logic_import_file(app_state *as,gchar *filename,gchar *keywords);
+/* Index files in the database (NULL terminated list) */
+void logic_import_files(app_state *as,gchar **filenames,gchar *keywords);
+
+/* Index every file found under a directory */
+void logic_import_dir(app_state *as,gchar *dirname,gchar *keywords);
+
+/* Finish the moves of an interrupted import. Needs the import lock */
+void logic_recover(app_state *as);
 
 /* Search files in the database */
 void logic_search(app_state *as,gchar *keywords);
+
+/* Find files with a boolean tag expression (AND, OR, NOT and parentheses) */
+void logic_query(app_state *as,gchar *expression);
 #endif
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+/* O_TMPFILE */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <linux/fs.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+#include "vault.h"
+#include "move.h"
+
+/*
+ * A rename is all that is needed on the same filesystem. Across
+ * filesystems (EXDEV) the file is copied inside the kernel:
+ *
+ * 1. FICLONE shares the blocks if both sides are on one
+ *    filesystem that can reflink (btrfs, xfs)
+ * 2. copy_file_range lets the filesystem copy (NFS does it on
+ *    the server)
+ * 3. sendfile copies through the page cache
+ *
+ * No step reads the file into the vault itself. The copy is made
+ * as an unnamed O_TMPFILE in the target directory (or under a
+ * unique MOVE_PARTIAL name), gets the mode, owner, times and
+ * extended attributes of the source, is synced and only then
+ * linked as target. The source is removed last, so a crash
+ * leaves the file in at least one complete place.
+ */
+
+/* Bytes asked from the kernel at once, it copies less anyway */
+#define MOVE_CHUNK (1024 * 1024 * 1024)
+
+static int open_partial(const gchar *target,gchar **partial);
+static gboolean link_partial(int fd,const gchar *partial,const gchar *target);
+static gboolean copy_data(int from,int to,off_t size);
+static void copy_metadata(int from,int to,const struct stat *info);
+static void copy_xattrs(int from,int to);
+static gboolean sync_directory(const gchar *path);
+
+gboolean move_file(app_state *as,const gchar *source,const gchar *target)
+{
+	struct stat info;
+	gchar *partial = NULL;
+	int from = -1;
+	int to = -1;
+	gboolean result = FALSE;
+
+	if(g_rename(source,target) == 0) return TRUE;
+	if(errno != EXDEV)
+	{
+		g_print("%s: %s\n",source,g_strerror(errno));
+		return FALSE;
+	}
+	if(as->debug_mode) g_debug("%s is on another filesystem, copying it\n",source);
+
+	from = open(source,O_RDONLY | O_CLOEXEC);
+	if(from < 0 || fstat(from,&info) != 0 || !S_ISREG(info.st_mode))
+	{
+		g_print("%s: Only regular files can be moved across filesystems\n",source);
+		if(from >= 0) close(from);
+		return FALSE;
+	}
+
+	to = open_partial(target,&partial);
+	if(to < 0) g_print("%s: %s\n",target,g_strerror(errno));
+	else if(copy_data(from,to,info.st_size))
+	{
+		copy_metadata(from,to,&info);
+		if(fsync(to) != 0 || !link_partial(to,partial,target))
+			g_print("%s: %s\n",target,g_strerror(errno));
+		else result = TRUE;
+	}
+	else g_print("%s: Could not copy: %s\n",source,g_strerror(errno));
+	close(from);
+
+	if(to >= 0)
+	{
+		close(to);
+		/* An unnamed copy disappears with its descriptor */
+		if(!result && partial != NULL) g_unlink(partial);
+	}
+	g_free(partial);
+	if(!result) return FALSE;
+
+	/* The new name has to be on disk before the old file goes */
+	sync_directory(target);
+	if(g_unlink(source) != 0)
+		g_print("%s: Copied into the vault but could not be removed: %s\n",source,g_strerror(errno));
+	return TRUE;
+}
+
+gboolean store_file(app_state *as,const gchar *source,const gchar *target)
+{
+	if(g_file_test(target,G_FILE_TEST_EXISTS))
+	{
+		/* Moved before a crash */
+		if(!g_file_test(source,G_FILE_TEST_EXISTS)) return TRUE;
+		/* Copied before a crash but the source was not removed yet */
+		if(move_interrupted(source,target))
+		{
+			g_unlink(source);
+			return TRUE;
+		}
+		g_print("%s: Already in the vault\n",target);
+		return FALSE;
+	}
+	if(as->debug_mode) g_debug("Moving file %s to  path %s\n",source,target);
+	return move_file(as,source,target);
+}
+
+void move_cleanup(const gchar *target)
+{
+	gchar *directory = g_path_get_dirname(target);
+	gchar *basename = g_path_get_basename(target);
+	gchar *partial = g_strconcat(basename,MOVE_PARTIAL,NULL);
+	gsize length = strlen(partial);
+	GDir *dir = g_dir_open(directory,0,NULL);
+	const gchar *name = NULL;
+
+	while(dir != NULL && (name = g_dir_read_name(dir)) != NULL)
+	{
+		/* Only the XXXXXX of the template differ */
+		if(strlen(name) == length && strncmp(name,partial,length - 6) == 0)
+		{
+			gchar *path = g_build_filename(directory,name,NULL);
+			g_unlink(path);
+			g_free(path);
+		}
+	}
+	if(dir != NULL) g_dir_close(dir);
+	g_free(partial);
+	g_free(basename);
+	g_free(directory);
+}
+
+gboolean move_interrupted(const gchar *source,const gchar *target)
+{
+	struct stat from;
+	struct stat to;
+
+	if(g_stat(source,&from) != 0 || g_stat(target,&to) != 0) return FALSE;
+	if(!S_ISREG(from.st_mode) || !S_ISREG(to.st_mode)) return FALSE;
+
+	/* Only copies get here, and a copy has the times of its source */
+	return from.st_dev != to.st_dev && from.st_size == to.st_size &&
+		from.st_mtim.tv_sec == to.st_mtim.tv_sec && from.st_mtim.tv_nsec == to.st_mtim.tv_nsec;
+}
+
+/*
+ * Opens the copy. partial is set to its name, or NULL for an
+ * O_TMPFILE that gets a name only in link_partial().
+ */
+static int open_partial(const gchar *target,gchar **partial)
+{
+#ifdef O_TMPFILE
+	gchar *directory = g_path_get_dirname(target);
+	int fd = open(directory,O_TMPFILE | O_WRONLY | O_CLOEXEC,0600);
+
+	g_free(directory);
+	*partial = NULL;
+	if(fd >= 0) return fd;
+#endif
+	/* Never a name that could already be in the vault */
+	*partial = g_strconcat(target,MOVE_PARTIAL,NULL);
+	return g_mkstemp_full(*partial,O_WRONLY | O_CLOEXEC,0600);
+}
+
+/* Gives the synced copy the name target */
+static gboolean link_partial(int fd,const gchar *partial,const gchar *target)
+{
+	gchar *path = NULL;
+	int rc;
+
+	/* Unlike a rename a link never replaces target */
+	if(partial != NULL)
+	{
+		if(link(partial,target) == 0)
+		{
+			g_unlink(partial);
+			return TRUE;
+		}
+		/* Filesystems without hard links (FAT) */
+		if(errno != EPERM && errno != EOPNOTSUPP) return FALSE;
+		if(g_file_test(target,G_FILE_TEST_EXISTS))
+		{
+			errno = EEXIST;
+			return FALSE;
+		}
+		return g_rename(partial,target) == 0;
+	}
+
+	path = g_strdup_printf("/proc/self/fd/%d",fd);
+	rc = linkat(AT_FDCWD,path,AT_FDCWD,target,AT_SYMLINK_FOLLOW);
+	g_free(path);
+	return rc == 0;
+}
+
+static gboolean copy_data(int from,int to,off_t size)
+{
+	off_t done = 0;
+	gboolean ranges = TRUE;
+
+#ifdef FICLONE
+	if(ioctl(to,FICLONE,from) == 0) return TRUE;
+#endif
+	/* Fails early on a full disk and keeps the file in one piece */
+	if(size > 0 && posix_fallocate(to,0,size) == ENOSPC)
+	{
+		errno = ENOSPC;
+		return FALSE;
+	}
+
+	while(done < size)
+	{
+		ssize_t copied = -1;
+		size_t length = MIN(size - done,MOVE_CHUNK);
+
+#ifdef __NR_copy_file_range
+		if(ranges)
+		{
+			copied = syscall(__NR_copy_file_range,from,NULL,to,NULL,length,0);
+			/* Old kernels and some filesystem pairs cannot do it */
+			if(copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+				ranges = FALSE;
+		}
+#else
+		ranges = FALSE;
+#endif
+		if(!ranges) copied = sendfile(to,from,NULL,length);
+
+		if(copied < 0 && errno == EINTR) continue;
+		if(copied <= 0) return FALSE; /* A shrinking source ends with 0 */
+		done += copied;
+	}
+	return TRUE;
+}
+
+/* Owner, mode and times. Only root may give files away, that can fail */
+static void copy_metadata(int from,int to,const struct stat *info)
+{
+	struct timespec times[2];
+
+	copy_xattrs(from,to);
+	if(fchown(to,info->st_uid,info->st_gid) != 0 && errno != EPERM)
+		g_warning("Could not set the owner: %s",g_strerror(errno));
+	fchmod(to,info->st_mode & 07777);
+
+	times[0] = info->st_atim;
+	times[1] = info->st_mtim;
+	futimens(to,times);
+}
+
+static void copy_xattrs(int from,int to)
+{
+	gchar *names = NULL;
+	gchar *name = NULL;
+	ssize_t length;
+
+	length = flistxattr(from,NULL,0);
+	if(length <= 0) return;
+	names = g_malloc(length);
+	length = flistxattr(from,names,length);
+
+	for(name = names;length > 0 && name < names + length;name += strlen(name) + 1)
+	{
+		ssize_t size = fgetxattr(from,name,NULL,0);
+		gchar *value = NULL;
+
+		if(size < 0) continue;
+		value = g_malloc(size + 1);
+		size = fgetxattr(from,name,value,size);
+		/* The target filesystem may not know the namespace */
+		if(size >= 0 && fsetxattr(to,name,value,size,0) != 0 && errno != ENOTSUP && errno != EPERM)
+			g_warning("Could not copy attribute %s: %s",name,g_strerror(errno));
+		g_free(value);
+	}
+	g_free(names);
+}
+
+static gboolean sync_directory(const gchar *path)
+{
+	gchar *directory = g_path_get_dirname(path);
+	int fd = open(directory,O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	gboolean result = FALSE;
+
+	if(fd >= 0)
+	{
+		result = fsync(fd) == 0;
+		close(fd);
+	}
+	g_free(directory);
+	return result;
+}
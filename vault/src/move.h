@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+
+#ifndef MOVE_H
+#define MOVE_H
+
+/* mkstemp template of a copy, used where O_TMPFILE is not supported */
+#define MOVE_PARTIAL ".part.XXXXXX"
+
+/*
+ * Moves a regular file to target, also across filesystems. The
+ * target must not exist. Returns FALSE (and leaves the source
+ * alone) if the file could not be moved.
+ */
+gboolean move_file(app_state *as,const gchar *source,const gchar *target);
+
+/*
+ * Moves a journalled file into the vault. TRUE also when an
+ * earlier run moved it already. An existing file is never replaced.
+ */
+gboolean store_file(app_state *as,const gchar *source,const gchar *target);
+
+/* Deletes copies for target that a crash left under a MOVE_PARTIAL name */
+void move_cleanup(const gchar *target);
+
+/* TRUE if target is a finished copy of source whose source was never removed */
+gboolean move_interrupted(const gchar *source,const gchar *target);
+
+#endif
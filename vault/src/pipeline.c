@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+#include "vault.h"
+#include "move.h"
+#include "pipeline.h"
+
+static gpointer scan_worker(gpointer data);
+static gpointer inspect_worker(gpointer data);
+static gpointer move_worker(gpointer data);
+static void scan_directory(Pipeline *pipeline,const gchar *dirname);
+static ImportItem *inspect(Pipeline *pipeline,gchar *path);
+static gchar *checksum_file(const gchar *filename);
+static void start_thread(Pipeline *pipeline,GThreadFunc worker);
+
+/* Constructor */
+Pipeline *create_Pipeline(app_state *as,gchar **filenames,const gchar *dirname)
+{
+	Pipeline *result = NULL;
+	long inspectors = sysconf(_SC_NPROCESSORS_ONLN);
+	long i;
+
+	if(inspectors < 1) inspectors = 1;
+
+	result = g_new0(Pipeline,1);
+	result->as = as;
+	result->filenames = filenames;
+	result->dirname = g_strdup(dirname);
+	result->paths = create_Channel(PIPELINE_QUEUE,1);
+	result->inspected = create_Channel(PIPELINE_QUEUE,inspectors);
+	result->moves = create_Channel(PIPELINE_QUEUE,1);
+	/* Never full, or movers and the writer could wait for each other */
+	result->moved = create_Channel(0,PIPELINE_MOVERS);
+	result->threads = g_ptr_array_new();
+
+	if(as->debug_mode) g_debug("Importing with %ld inspectors and %d movers\n",inspectors,PIPELINE_MOVERS);
+	start_thread(result,scan_worker);
+	for(i = 0;i < inspectors;i++)
+		start_thread(result,inspect_worker);
+	for(i = 0;i < PIPELINE_MOVERS;i++)
+		start_thread(result,move_worker);
+	return result;
+}
+
+ImportItem *pipeline_next(Pipeline *pipeline)
+{
+	return channel_pop(pipeline->inspected);
+}
+
+gboolean pipeline_move(Pipeline *pipeline,ImportItem *item)
+{
+	return channel_try_push(pipeline->moves,item);
+}
+
+ImportItem *pipeline_moved(Pipeline *pipeline,gboolean wait)
+{
+	if(wait) return channel_pop(pipeline->moved);
+	return channel_try_pop(pipeline->moved);
+}
+
+void pipeline_moves_done(Pipeline *pipeline)
+{
+	if(pipeline->moves_done) return;
+	pipeline->moves_done = TRUE;
+	channel_close(pipeline->moves);
+}
+
+gint pipeline_found(Pipeline *pipeline)
+{
+	return g_atomic_int_get(&pipeline->found);
+}
+
+/* Destructor */
+void free_Pipeline(Pipeline *pipeline)
+{
+	ImportItem *item = NULL;
+	guint i;
+
+	/* Whatever was not imported yet is dropped */
+	g_atomic_int_set(&pipeline->cancelled,1);
+	while((item = channel_pop(pipeline->inspected)) != NULL)
+		free_ImportItem(item);
+	pipeline_moves_done(pipeline);
+	while((item = channel_pop(pipeline->moved)) != NULL)
+		free_ImportItem(item);
+
+	for(i = 0;i < pipeline->threads->len;i++)
+		g_thread_join(g_ptr_array_index(pipeline->threads,i));
+	g_ptr_array_free(pipeline->threads,TRUE);
+
+	free_Channel(pipeline->paths);
+	free_Channel(pipeline->inspected);
+	free_Channel(pipeline->moves);
+	free_Channel(pipeline->moved);
+	g_free(pipeline->dirname);
+	g_free(pipeline);
+}
+
+void free_ImportItem(ImportItem *item)
+{
+	g_free(item->source);
+	g_free(item->target);
+	g_free(item->checksum);
+	g_free(item);
+}
+
+/* Walks the paths given, or the directory */
+static gpointer scan_worker(gpointer data)
+{
+	Pipeline *pipeline = (Pipeline *)data;
+	int i;
+
+	for(i = 0;pipeline->filenames != NULL && pipeline->filenames[i] != NULL;i++)
+	{
+		if(g_atomic_int_get(&pipeline->cancelled)) break;
+		g_atomic_int_inc(&pipeline->found);
+		channel_push(pipeline->paths,g_strdup(pipeline->filenames[i]));
+	}
+	if(pipeline->dirname != NULL) scan_directory(pipeline,pipeline->dirname);
+
+	channel_close(pipeline->paths);
+	return NULL;
+}
+
+/* Sub-directories are walked but not imported themselves */
+static void scan_directory(Pipeline *pipeline,const gchar *dirname)
+{
+	GDir *dir = NULL;
+	const gchar *name = NULL;
+
+	dir = g_dir_open(dirname,0,NULL);
+	if(dir == NULL)
+	{
+		g_print("%s: Could not read directory\n",dirname);
+		return;
+	}
+	while((name = g_dir_read_name(dir)) != NULL && !g_atomic_int_get(&pipeline->cancelled))
+	{
+		gchar *path = g_build_filename(dirname,name,NULL);
+
+		/* Symbolic links to directories could loop */
+		if(g_file_test(path,G_FILE_TEST_IS_DIR) && !g_file_test(path,G_FILE_TEST_IS_SYMLINK))
+		{
+			scan_directory(pipeline,path);
+			g_free(path);
+		}
+		else if(g_file_test(path,G_FILE_TEST_IS_REGULAR))
+		{
+			g_atomic_int_inc(&pipeline->found);
+			channel_push(pipeline->paths,path);
+		}
+		else
+			g_free(path);
+	}
+	g_dir_close(dir);
+}
+
+static gpointer inspect_worker(gpointer data)
+{
+	Pipeline *pipeline = (Pipeline *)data;
+	gchar *path = NULL;
+
+	while((path = channel_pop(pipeline->paths)) != NULL)
+	{
+		if(g_atomic_int_get(&pipeline->cancelled)) g_free(path);
+		else channel_push(pipeline->inspected,inspect(pipeline,path));
+	}
+	channel_close(pipeline->inspected);
+	return NULL;
+}
+
+/* Takes path. The item is not ok if the file cannot be imported */
+static ImportItem *inspect(Pipeline *pipeline,gchar *path)
+{
+	ImportItem *item = g_new0(ImportItem,1);
+	struct stat info;
+
+	if(g_path_is_absolute(path)) item->source = path;
+	else
+	{
+		gchar *current = g_get_current_dir();
+		item->source = g_build_filename(current,path,NULL);
+		g_free(current);
+		g_free(path);
+	}
+
+	/* It can also be a directory */
+	if(g_stat(item->source,&info) != 0)
+	{
+		g_print("%s: No such file or directory\n",item->source);
+		return item;
+	}
+	item->size = info.st_size;
+
+	if(pipeline->as->checksum_mode && S_ISREG(info.st_mode))
+	{
+		item->checksum = checksum_file(item->source);
+		if(item->checksum == NULL)
+		{
+			g_print("%s: Could not read file\n",item->source);
+			return item;
+		}
+	}
+	item->ok = TRUE;
+	return item;
+}
+
+static gchar *checksum_file(const gchar *filename)
+{
+	GChecksum *checksum = NULL;
+	guchar *buffer = NULL;
+	gchar *result = NULL;
+	ssize_t length;
+	int fd;
+
+	fd = open(filename,O_RDONLY | O_CLOEXEC);
+	if(fd < 0) return NULL;
+	posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+
+	checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	buffer = g_malloc(PIPELINE_CHUNK);
+	while((length = read(fd,buffer,PIPELINE_CHUNK)) > 0)
+		g_checksum_update(checksum,buffer,length);
+	if(length == 0) result = g_strdup(g_checksum_get_string(checksum));
+
+	g_checksum_free(checksum);
+	g_free(buffer);
+	close(fd);
+	return result;
+}
+
+static gpointer move_worker(gpointer data)
+{
+	Pipeline *pipeline = (Pipeline *)data;
+	ImportItem *item = NULL;
+
+	while((item = channel_pop(pipeline->moves)) != NULL)
+	{
+		item->ok = store_file(pipeline->as,item->source,item->target);
+		channel_push(pipeline->moved,item);
+	}
+	channel_close(pipeline->moved);
+	return NULL;
+}
+
+static void start_thread(Pipeline *pipeline,GThreadFunc worker)
+{
+	GError *error = NULL;
+	GThread *thread = g_thread_create(worker,pipeline,TRUE,&error);
+
+	if(thread == NULL)
+	{
+		g_critical("Could not start import thread: %s\n",error->message);
+		exit(1);
+	}
+	g_ptr_array_add(pipeline->threads,thread);
+}
+
+/* Constructor */
+Channel *create_Channel(guint limit,guint producers)
+{
+	Channel *result = g_new0(Channel,1);
+
+	result->lock = g_mutex_new();
+	result->readable = g_cond_new();
+	result->writable = g_cond_new();
+	result->items = g_queue_new();
+	result->limit = limit;
+	result->producers = producers;
+	return result;
+}
+
+void channel_push(Channel *channel,gpointer item)
+{
+	g_mutex_lock(channel->lock);
+	while(channel->limit > 0 && g_queue_get_length(channel->items) >= channel->limit)
+		g_cond_wait(channel->writable,channel->lock);
+	g_queue_push_tail(channel->items,item);
+	g_cond_signal(channel->readable);
+	g_mutex_unlock(channel->lock);
+}
+
+gboolean channel_try_push(Channel *channel,gpointer item)
+{
+	gboolean result = FALSE;
+
+	g_mutex_lock(channel->lock);
+	if(channel->limit == 0 || g_queue_get_length(channel->items) < channel->limit)
+	{
+		g_queue_push_tail(channel->items,item);
+		g_cond_signal(channel->readable);
+		result = TRUE;
+	}
+	g_mutex_unlock(channel->lock);
+	return result;
+}
+
+gpointer channel_pop(Channel *channel)
+{
+	gpointer result = NULL;
+
+	g_mutex_lock(channel->lock);
+	while(g_queue_is_empty(channel->items) && channel->producers > 0)
+		g_cond_wait(channel->readable,channel->lock);
+	result = g_queue_pop_head(channel->items);
+	if(result != NULL) g_cond_signal(channel->writable);
+	g_mutex_unlock(channel->lock);
+	return result;
+}
+
+gpointer channel_try_pop(Channel *channel)
+{
+	gpointer result = NULL;
+
+	g_mutex_lock(channel->lock);
+	result = g_queue_pop_head(channel->items);
+	if(result != NULL) g_cond_signal(channel->writable);
+	g_mutex_unlock(channel->lock);
+	return result;
+}
+
+void channel_close(Channel *channel)
+{
+	g_mutex_lock(channel->lock);
+	channel->producers--;
+	/* Every consumer has to see the end */
+	if(channel->producers == 0) g_cond_broadcast(channel->readable);
+	g_mutex_unlock(channel->lock);
+}
+
+/* Destructor */
+void free_Channel(Channel *channel)
+{
+	g_mutex_free(channel->lock);
+	g_cond_free(channel->readable);
+	g_cond_free(channel->writable);
+	g_queue_free(channel->items);
+	g_free(channel);
+}
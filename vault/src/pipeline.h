@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/* Items waiting between two stages */
+#define PIPELINE_QUEUE 256
+/* Threads that copy files into the vault */
+#define PIPELINE_MOVERS 4
+/* Read size while computing checksums */
+#define PIPELINE_CHUNK (64 * 1024)
+
+/*
+ * A queue between stages. Pushing waits while limit items are
+ * queued, popping waits for an item. Once every producer has
+ * closed it, popping an empty channel returns NULL.
+ */
+typedef struct channel
+{
+	GMutex *lock;
+	GCond *readable;
+	GCond *writable;
+	GQueue *items;
+	guint limit; /* 0 for no limit */
+	guint producers;
+}Channel;
+
+/* A file on its way into the vault */
+typedef struct import_item
+{
+	gchar *source; /* Absolute path */
+	gchar *target; /* Inside the store, chosen by the writer */
+	sqlite3_int64 fileid;
+	gint64 size;
+	gchar *checksum; /* SHA-256, only with --checksum */
+	gboolean ok; /* Could be read, later could be moved */
+}ImportItem;
+
+/*
+ * The stages of an import. One thread walks the paths, a thread
+ * per processor stats (and checksums) them and PIPELINE_MOVERS
+ * threads move committed files into the vault. The database is
+ * written by the caller alone, it takes inspected items and gives
+ * back items to move.
+ */
+typedef struct import_pipeline
+{
+	app_state *as;
+	Channel *paths; /* gchar * */
+	Channel *inspected; /* ImportItem */
+	Channel *moves; /* ImportItem */
+	Channel *moved; /* ImportItem */
+	GPtrArray *threads;
+	gchar **filenames;
+	gchar *dirname;
+	gint found;
+	gint cancelled;
+	gboolean moves_done;
+}Pipeline;
+
+/* Constructor. Starts importing the files, or everything under dirname */
+Pipeline *create_Pipeline(app_state *as,gchar **filenames,const gchar *dirname);
+
+/* Next file to put in the database, NULL when there are no more */
+ImportItem *pipeline_next(Pipeline *pipeline);
+
+/*
+ * Hands a file that is in the journal to the movers. FALSE if
+ * PIPELINE_QUEUE files already wait, try again after a move.
+ */
+gboolean pipeline_move(Pipeline *pipeline,ImportItem *item);
+
+/* A finished move. With wait it blocks, and NULL means all moves are done */
+ImportItem *pipeline_moved(Pipeline *pipeline,gboolean wait);
+
+/* No more moves will be asked for */
+void pipeline_moves_done(Pipeline *pipeline);
+
+/* Files found so far */
+gint pipeline_found(Pipeline *pipeline);
+
+/* Destructor. Stops what is still running */
+void free_Pipeline(Pipeline *pipeline);
+
+void free_ImportItem(ImportItem *item);
+
+Channel *create_Channel(guint limit,guint producers);
+void channel_push(Channel *channel,gpointer item);
+/* FALSE instead of waiting when the channel is full */
+gboolean channel_try_push(Channel *channel,gpointer item);
+gpointer channel_pop(Channel *channel);
+gpointer channel_try_pop(Channel *channel);
+/* Called once by every producer */
+void channel_close(Channel *channel);
+void free_Channel(Channel *channel);
+
+#endif
@@ -28,4 +28,61 @@
 
 #define TABLE_RECENT "CREATE TABLE recent(fileid INTEGER PRIMARY KEY, popularity INTEGER)"
 
+/*
+ * Changes after the first version. The schema version is kept in
+ * PRAGMA user_version. Databases without one have only the tables
+ * above and get every migration up to SCHEMA_VERSION.
+ */
+#define SCHEMA_VERSION 6
+
+/* Version 1. Moves of imported files that are not finished yet */
+#define TABLE_JOURNAL "CREATE TABLE IF NOT EXISTS journal (fileid INTEGER PRIMARY KEY, source VARCHAR(255), target VARCHAR(255))"
+
+/* Version 2. Tag counts, searches and deletes stop scanning match */
+#define INDEX_MATCH_TAG "CREATE INDEX IF NOT EXISTS match_tag ON match (tag, fileid)"
+#define INDEX_MATCH_FILE "CREATE INDEX IF NOT EXISTS match_file ON match (fileid)"
+
+/*
+ * Version 3. Full text index over filenames, descriptions and tags
+ * (rowid is the fileid). Triggers keep it in sync with files and
+ * match, so nothing else has to know about it.
+ */
+#define TABLE_SEARCH "CREATE VIRTUAL TABLE search USING fts5(filename, description, tags, prefix='2 3')"
+#define FILL_SEARCH "INSERT INTO search (rowid, filename, description, tags) SELECT fileid, filename, description, (SELECT group_concat(tag,' ') FROM match WHERE match.fileid = files.fileid) FROM files"
+#define TRIGGER_FILE_INSERT "CREATE TRIGGER search_file_insert AFTER INSERT ON files BEGIN INSERT INTO search (rowid, filename, description, tags) VALUES (new.fileid, new.filename, new.description, ''); END"
+#define TRIGGER_FILE_UPDATE "CREATE TRIGGER search_file_update AFTER UPDATE OF filename, description ON files BEGIN UPDATE search SET filename = new.filename, description = new.description WHERE rowid = new.fileid; END"
+#define TRIGGER_FILE_DELETE "CREATE TRIGGER search_file_delete AFTER DELETE ON files BEGIN DELETE FROM search WHERE rowid = old.fileid; END"
+#define TRIGGER_MATCH_INSERT "CREATE TRIGGER search_match_insert AFTER INSERT ON match BEGIN UPDATE search SET tags = (SELECT group_concat(tag,' ') FROM match WHERE fileid = new.fileid) WHERE rowid = new.fileid; END"
+#define TRIGGER_MATCH_DELETE "CREATE TRIGGER search_match_delete AFTER DELETE ON match BEGIN UPDATE search SET tags = (SELECT group_concat(tag,' ') FROM match WHERE fileid = old.fileid) WHERE rowid = old.fileid; END"
+
+/*
+ * Version 4. Every tag knows how many files it has. Triggers keep
+ * the count right, also when a savepoint or transaction rolls back.
+ */
+#define COLUMN_TAG_COUNT "ALTER TABLE tags ADD COLUMN count INTEGER NOT NULL DEFAULT 0"
+#define FILL_TAG_COUNT "UPDATE tags SET count = (SELECT count(*) FROM match WHERE match.tag = tags.name)"
+#define TRIGGER_COUNT_INSERT "CREATE TRIGGER tag_count_insert AFTER INSERT ON match BEGIN UPDATE tags SET count = count + 1 WHERE name = new.tag; END"
+#define TRIGGER_COUNT_DELETE "CREATE TRIGGER tag_count_delete AFTER DELETE ON match BEGIN UPDATE tags SET count = count - 1 WHERE name = old.tag; END"
+
+/*
+ * Version 5. Totals for vault --numbers, so it reads a few rows
+ * instead of counting. The bytes of a tag are the sizes of its
+ * files. A match is always inserted after its file and deleted
+ * before it, so the size can be looked up in files.
+ */
+#define TABLE_STATS "CREATE TABLE stats (name VARCHAR(50) PRIMARY KEY, value INTEGER NOT NULL DEFAULT 0)"
+#define FILL_STATS "INSERT INTO stats (name, value) SELECT 'files', count(*) FROM files UNION ALL SELECT 'bytes', ifnull(sum(size),0) FROM files UNION ALL SELECT 'tags', count(*) FROM tags UNION ALL SELECT 'matches', count(*) FROM match"
+#define COLUMN_TAG_BYTES "ALTER TABLE tags ADD COLUMN bytes INTEGER NOT NULL DEFAULT 0"
+#define FILL_TAG_BYTES "UPDATE tags SET bytes = (SELECT ifnull(sum(files.size),0) FROM match, files WHERE match.tag = tags.name AND files.fileid = match.fileid)"
+#define TRIGGER_STATS_FILE_INSERT "CREATE TRIGGER stats_file_insert AFTER INSERT ON files BEGIN UPDATE stats SET value = value + 1 WHERE name = 'files'; UPDATE stats SET value = value + ifnull(new.size,0) WHERE name = 'bytes'; END"
+#define TRIGGER_STATS_FILE_UPDATE "CREATE TRIGGER stats_file_update AFTER UPDATE OF size ON files BEGIN UPDATE stats SET value = value - ifnull(old.size,0) + ifnull(new.size,0) WHERE name = 'bytes'; UPDATE tags SET bytes = bytes - ifnull(old.size,0) + ifnull(new.size,0) WHERE name IN (SELECT tag FROM match WHERE fileid = new.fileid); END"
+#define TRIGGER_STATS_FILE_DELETE "CREATE TRIGGER stats_file_delete AFTER DELETE ON files BEGIN UPDATE stats SET value = value - 1 WHERE name = 'files'; UPDATE stats SET value = value - ifnull(old.size,0) WHERE name = 'bytes'; END"
+#define TRIGGER_STATS_TAG_INSERT "CREATE TRIGGER stats_tag_insert AFTER INSERT ON tags BEGIN UPDATE stats SET value = value + 1 WHERE name = 'tags'; END"
+#define TRIGGER_STATS_TAG_DELETE "CREATE TRIGGER stats_tag_delete AFTER DELETE ON tags BEGIN UPDATE stats SET value = value - 1 WHERE name = 'tags'; END"
+#define TRIGGER_STATS_MATCH_INSERT "CREATE TRIGGER stats_match_insert AFTER INSERT ON match BEGIN UPDATE stats SET value = value + 1 WHERE name = 'matches'; UPDATE tags SET bytes = bytes + (SELECT ifnull(size,0) FROM files WHERE fileid = new.fileid) WHERE name = new.tag; END"
+#define TRIGGER_STATS_MATCH_DELETE "CREATE TRIGGER stats_match_delete AFTER DELETE ON match BEGIN UPDATE stats SET value = value - 1 WHERE name = 'matches'; UPDATE tags SET bytes = bytes - (SELECT ifnull(size,0) FROM files WHERE fileid = old.fileid) WHERE name = old.tag; END"
+
+/* Version 6. SHA-256 of the file, NULL unless imported with --checksum */
+#define COLUMN_FILE_CHECKSUM "ALTER TABLE files ADD COLUMN checksum VARCHAR(64)"
+
 #endif
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+#include "vault.h"
+#include "db.h"
+#include "bitmap.h"
+#include "tagindex.h"
+
+/*
+ * Layout of the index file. All offsets are from the start of the
+ * file and every bitmap starts 8 byte aligned.
+ *
+ *	header
+ *	bitmap of all files
+ *	bitmap of each tag
+ *	tag names (NUL terminated)
+ *	directory of tag_index_entry, sorted by name
+ *
+ * The header remembers the last fileid and match row it has seen.
+ * If the database has moved on the index is built again.
+ */
+typedef struct tag_index_header
+{
+	gchar magic[4];
+	guint32 version;
+	guint32 tags;
+	guint32 reserved;
+	gint64 last_file;
+	gint64 last_match;
+	guint64 all; /* Offset of the bitmap of all files */
+	guint64 directory;
+}IndexHeader;
+
+struct tag_index_entry
+{
+	guint32 name;
+	guint32 length; /* Of the bitmap */
+	guint64 bitmap;
+};
+
+static gboolean build_index(app_state *as);
+static void write_tag(GString *out,GString *names,GArray *entries,const gchar *tag,Bitmap *files);
+static gboolean map_index(app_state *as,TagIndex *index);
+static gboolean database_position(app_state *as,gint64 *last_file,gint64 *last_match);
+static void unmap_index(TagIndex *index);
+
+/* Constructor */
+TagIndex *tagindex_open(app_state *as)
+{
+	TagIndex *result = g_new0(TagIndex,1);
+
+	if(map_index(as,result)) return result;
+
+	if(as->debug_mode) g_debug("Building the tag index at %s\n",as->index_path);
+	if(build_index(as) && map_index(as,result)) return result;
+
+	g_free(result);
+	return NULL;
+}
+
+Bitmap *tagindex_lookup(TagIndex *index,const gchar *tag)
+{
+	guint32 first = 0;
+	guint32 last = index->tags;
+	Bitmap *result = NULL;
+
+	while(first < last)
+	{
+		guint32 middle = (first + last) / 2;
+		const struct tag_index_entry *entry = &index->entries[middle];
+		int compare = strcmp((const gchar *)index->data + entry->name,tag);
+
+		if(compare == 0)
+		{
+			result = bitmap_view(index->data + entry->bitmap,entry->length);
+			break;
+		}
+		if(compare < 0) first = middle + 1;
+		else last = middle;
+	}
+	if(result == NULL) result = create_Bitmap();
+	return result;
+}
+
+void tagindex_invalidate(app_state *as)
+{
+	if(g_unlink(as->index_path) == 0 && as->debug_mode)
+		g_debug("Removed the tag index\n");
+}
+
+/* Destructor */
+void free_TagIndex(TagIndex *index)
+{
+	unmap_index(index);
+	g_free(index);
+}
+
+static gboolean build_index(app_state *as)
+{
+	IndexHeader header;
+	GString *out = NULL;
+	GString *names = NULL;
+	GArray *entries = NULL;
+	Bitmap *files = NULL;
+	sqlite3_stmt *statement = NULL;
+	gchar *tag = NULL;
+	GError *error = NULL;
+	gboolean result = FALSE;
+	guint i;
+	int rc;
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,TAG_INDEX_MAGIC,4);
+	header.version = TAG_INDEX_VERSION;
+	if(!database_position(as,&header.last_file,&header.last_match)) return FALSE;
+
+	out = g_string_new(NULL);
+	names = g_string_new(NULL);
+	entries = g_array_new(FALSE,FALSE,sizeof(struct tag_index_entry));
+	g_string_append_len(out,(const gchar *)&header,sizeof(header));
+
+	/* Every file, NOT needs them */
+	files = create_Bitmap();
+	statement = dbfs_statement(as,SQL_ALL_FILES);
+	while((rc = sqlite3_step(statement)) == SQLITE_ROW)
+	{
+		sqlite3_int64 fileid = sqlite3_column_int64(statement,0);
+		if(fileid >= 0 && fileid <= G_MAXUINT32) bitmap_add(files,fileid);
+	}
+	sqlite3_reset(statement);
+	if(rc != SQLITE_DONE) goto failed;
+	header.all = bitmap_write(files,out);
+	free_Bitmap(files);
+	files = NULL;
+
+	/* Then one bitmap per tag. Sorted like strcmp sorts */
+	statement = dbfs_statement(as,SQL_TAG_FILES);
+	while((rc = sqlite3_step(statement)) == SQLITE_ROW)
+	{
+		const gchar *name = (const gchar *)sqlite3_column_text(statement,0);
+		sqlite3_int64 fileid = sqlite3_column_int64(statement,1);
+
+		if(name == NULL || fileid < 0 || fileid > G_MAXUINT32) continue;
+		if(tag == NULL || strcmp(tag,name) != 0)
+		{
+			if(tag != NULL) write_tag(out,names,entries,tag,files);
+			g_free(tag);
+			tag = g_strdup(name);
+			files = create_Bitmap();
+		}
+		bitmap_add(files,fileid);
+	}
+	sqlite3_reset(statement);
+	if(rc != SQLITE_DONE) goto failed;
+	if(tag != NULL) write_tag(out,names,entries,tag,files);
+	files = NULL;
+
+	/* Names and the directory close the file */
+	for(i = 0;i < entries->len;i++)
+		g_array_index(entries,struct tag_index_entry,i).name += out->len;
+	g_string_append_len(out,names->str,names->len);
+	while(out->len % 8 != 0) g_string_append_c(out,'\0');
+	header.tags = entries->len;
+	header.directory = out->len;
+	g_string_append_len(out,entries->data,entries->len * sizeof(struct tag_index_entry));
+	memcpy(out->str,&header,sizeof(header));
+
+	result = g_file_set_contents(as->index_path,out->str,out->len,&error);
+	if(!result)
+	{
+		g_warning("Could not write the tag index: %s",error->message);
+		g_error_free(error);
+	}
+	else if(as->debug_mode) g_debug("Tag index has %d tags in %lu bytes\n",entries->len,(gulong)out->len);
+
+failed:
+	if(rc != SQLITE_DONE) g_warning("Could not read the tags: %s",sqlite3_errmsg(as->db));
+	if(files != NULL) free_Bitmap(files);
+	g_free(tag);
+	g_array_free(entries,TRUE);
+	g_string_free(names,TRUE);
+	g_string_free(out,TRUE);
+	return result;
+}
+
+/* Writes the bitmap of one tag and frees it */
+static void write_tag(GString *out,GString *names,GArray *entries,const gchar *tag,Bitmap *files)
+{
+	struct tag_index_entry entry;
+
+	entry.bitmap = bitmap_write(files,out);
+	entry.length = out->len - entry.bitmap;
+	entry.name = names->len; /* Moved past the bitmaps later */
+	g_string_append_len(names,tag,strlen(tag) + 1);
+	g_array_append_val(entries,entry);
+	free_Bitmap(files);
+}
+
+/* Maps the index and checks that it can be trusted */
+static gboolean map_index(app_state *as,TagIndex *index)
+{
+	const IndexHeader *header = NULL;
+	gint64 last_file = 0;
+	gint64 last_match = 0;
+	guint32 i;
+
+	index->file = g_mapped_file_new(as->index_path,FALSE,NULL);
+	if(index->file == NULL) return FALSE;
+	index->data = (const guint8 *)g_mapped_file_get_contents(index->file);
+	index->size = g_mapped_file_get_length(index->file);
+
+	header = (const IndexHeader *)index->data;
+	if(index->size < sizeof(IndexHeader) || memcmp(header->magic,TAG_INDEX_MAGIC,4) != 0 ||
+			header->version != TAG_INDEX_VERSION ||
+			header->directory % 8 != 0 || header->directory > index->size ||
+			(guint64)header->tags * sizeof(struct tag_index_entry) > index->size - header->directory ||
+			header->all >= index->size)
+		goto invalid;
+
+	if(!database_position(as,&last_file,&last_match) ||
+			header->last_file != last_file || header->last_match != last_match)
+	{
+		if(as->debug_mode) g_debug("Tag index is out of date\n");
+		goto invalid;
+	}
+
+	index->tags = header->tags;
+	index->entries = (const struct tag_index_entry *)(index->data + header->directory);
+	for(i = 0;i < index->tags;i++)
+	{
+		const struct tag_index_entry *entry = &index->entries[i];
+
+		if(entry->name >= header->directory ||
+				memchr(index->data + entry->name,'\0',header->directory - entry->name) == NULL ||
+				entry->bitmap > index->size || entry->length > index->size - entry->bitmap)
+			goto invalid;
+	}
+	index->all = bitmap_view(index->data + header->all,index->size - header->all);
+	if(index->all == NULL) goto invalid;
+	return TRUE;
+
+invalid:
+	if(as->debug_mode) g_debug("Ignoring the tag index at %s\n",as->index_path);
+	unmap_index(index);
+	return FALSE;
+}
+
+/* The newest file and match. Imports move them, deletes invalidate the index */
+static gboolean database_position(app_state *as,gint64 *last_file,gint64 *last_match)
+{
+	sqlite3_stmt *statement = dbfs_statement(as,SQL_LAST_ROWS);
+	gboolean result = FALSE;
+
+	if(sqlite3_step(statement) == SQLITE_ROW)
+	{
+		*last_file = sqlite3_column_int64(statement,0);
+		*last_match = sqlite3_column_int64(statement,1);
+		result = TRUE;
+	}
+	sqlite3_reset(statement);
+	return result;
+}
+
+static void unmap_index(TagIndex *index)
+{
+	if(index->all != NULL) free_Bitmap(index->all);
+	if(index->file != NULL) g_mapped_file_free(index->file);
+	index->all = NULL;
+	index->file = NULL;
+	index->data = NULL;
+	index->entries = NULL;
+	index->tags = 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2006-2008 Kapelonis Kostis  <kkapelon@freemail.gr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * Vault -- The storage component of Project Elevate.
+*/
+
+#ifndef TAGINDEX_H
+#define TAGINDEX_H
+
+#define TAG_INDEX_MAGIC "VTBM"
+#define TAG_INDEX_VERSION 1
+
+/*
+ * The files of every tag as a bitmap, kept next to the database in
+ * TAG_INDEX_NAME and mapped into memory. It is rebuilt from the
+ * match table when it is missing or no longer matches the database.
+ */
+typedef struct tag_index
+{
+	GMappedFile *file;
+	const guint8 *data;
+	gsize size;
+	guint32 tags;
+	const struct tag_index_entry *entries; /* Sorted by name */
+	Bitmap *all; /* Every file in the vault */
+}TagIndex;
+
+/* Constructor. Maps the index, building it first if needed */
+TagIndex *tagindex_open(app_state *as);
+
+/* Files with the tag. Read only, empty for an unknown tag */
+Bitmap *tagindex_lookup(TagIndex *index,const gchar *tag);
+
+/* Makes the next tagindex_open rebuild the index */
+void tagindex_invalidate(app_state *as);
+
+/* Destructor */
+void free_TagIndex(TagIndex *index);
+
+#endif
@@ -35,8 +35,12 @@
  * 	vault --build
  * 2. Add files/folders
  * 	vault --add /incoming/report.pdf --tags sales,2008,report
+ * 	vault --add a.pdf b.pdf c.pdf --tags sales
+ * 	vault --add-dir /incoming --tags sales
+ * 	find /incoming -name '*.pdf' | vault --add - --tags sales
  * 3. Search files
  * 	vault --search --tags video,movies
+ * 	vault --search --query "video AND 2008 AND NOT trailers"
  * 4. Show tags already defined
  * 	vault --present
  * 5. Show statistics
@@ -47,28 +51,35 @@
  * We also have
  *  --force for rebuilding the database when it exists
  *  --debug that shows more info
+ *  --checksum that keeps a SHA-256 of every imported file
  */
 static gboolean build = FALSE;
 static gchar *add = NULL;
+static gchar *add_dir = NULL;
 static gchar *tags = NULL;
+static gchar *query = NULL;
 static gboolean search = FALSE;
 static gboolean present = FALSE;
 static gboolean recent = FALSE;
 static gboolean numbers = FALSE;
 static gboolean version = FALSE;
 static gboolean debug = FALSE;
+static gboolean checksum = FALSE;
 
 static GOptionEntry entries[] = 
 {
   { "build", 0, 0, G_OPTION_ARG_NONE, &build, "Build the database that holds tags", NULL },
-  { "add", 'a', 0, G_OPTION_ARG_FILENAME, &add, "file/folder to add in the database", "path" },
+  { "add", 'a', 0, G_OPTION_ARG_FILENAME, &add, "file/folder to add in the database (more can follow, - reads them from stdin)", "path" },
+  { "add-dir", 0, 0, G_OPTION_ARG_FILENAME, &add_dir, "Add all files under a folder", "path" },
   { "tags", 't', 0, G_OPTION_ARG_STRING, &tags, "Tags (separated with ,)", "keywords" },
   { "search", 's', 0, G_OPTION_ARG_NONE, &search, "Search the database", NULL },
+  { "query", 'q', 0, G_OPTION_ARG_STRING, &query, "Tags combined with AND, OR, NOT and ()", "expression" },
   { "present", 'p', 0, G_OPTION_ARG_NONE, &present, "Show existing tags present in the database", NULL },
   { "recent", 'r', 0, G_OPTION_ARG_NONE, &recent, "Show recent files", NULL },
   { "numbers", 'n', 0, G_OPTION_ARG_NONE, &numbers, "Show statistics for the database", NULL },
   { "version", 'v', 0, G_OPTION_ARG_NONE, &version, "Show version and exit", NULL },
   { "debug", 'd', 0, G_OPTION_ARG_NONE, &debug, "Print debugging information", NULL },
+  { "checksum", 'c', 0, G_OPTION_ARG_NONE, &checksum, "Keep a checksum of imported files (reads them all)", NULL },
   { NULL }
 };
 
@@ -76,13 +87,16 @@ static void show_version(void);
 static void show_stats(app_state *as);
 static void show_recent(void);
 static void search_files(app_state *as,gchar *keywords);
+static void query_files(app_state *as,gchar *expression);
 static void show_present(app_state *as);
-static void add_file(app_state *as,gchar *filename,gchar *keywords);
+static void add_files(app_state *as,gchar **filenames,gchar *keywords);
+static void add_folder(app_state *as,gchar *dirname,gchar *keywords);
+static gchar **read_filenames(gchar *first,int argc,char **argv);
 static void build_db(app_state *as);
 static app_state *init(gboolean debug);
 
 
-static void start_working(app_state *as);
+static void start_working(app_state *as,gboolean import);
 static void finish_working(app_state *as);
 
 int main(int argc, char ** argv) 
@@ -91,6 +105,9 @@ int main(int argc, char ** argv)
 	GOptionContext *context;
 	app_state *as = NULL;
 
+	/* Imports run in several threads */
+	if(!g_thread_supported()) g_thread_init(NULL);
+
 	context = g_option_context_new ("- manage the vault tag database");
 	g_option_context_add_main_entries (context, entries, NULL);
 	g_option_context_set_description (context,"Report bugs to <kkapelon@freemail.gr>.");
@@ -108,12 +125,17 @@ int main(int argc, char ** argv)
 	 * functions of the programs
 	 */
 	as = init(debug);
+	as->checksum_mode = checksum;
 	
 	
 	/* Take action depending on command line arguments */
 	if(version == TRUE) show_version();
 	else if(numbers == TRUE) show_stats(as);
 	else if(recent == TRUE) show_recent();
+	else if(search == TRUE && query != NULL)
+	{
+		query_files(as,query);
+	}
 	else if(search == TRUE && tags != NULL) 
 	{
 		search_files(as,tags);
@@ -121,7 +143,13 @@ int main(int argc, char ** argv)
 	else if(present == TRUE) show_present(as);
 	else if (add != NULL && tags != NULL)
 	{
-		add_file(as,add,tags);
+		gchar **filenames = read_filenames(add,argc,argv);
+		add_files(as,filenames,tags);
+		g_strfreev(filenames);
+	}
+	else if (add_dir != NULL && tags != NULL)
+	{
+		add_folder(as,add_dir,tags);
 	}
 	else if(build == TRUE)
 	{
@@ -150,7 +178,7 @@ static void show_stats(app_state *as)
 	g_print("%s\n",PROGRAM_NAME);
 	g_print("Database Statistics:\n");
 
-	start_working(as);
+	start_working(as,FALSE);
 
 	logic_print_statistics(as);
 
@@ -168,7 +196,7 @@ static void show_present(app_state *as)
 	g_print("Existing tags:\n");
 
 
-	start_working(as);
+	start_working(as,FALSE);
 
 	logic_print_tags(as);
 
@@ -180,28 +208,97 @@ static void search_files(app_state *as,gchar *keywords)
 	g_print("%s\n",PROGRAM_NAME);
 	g_print("Tags are: %s\n",keywords);
 
-	start_working(as);
+	start_working(as,FALSE);
 	
 	logic_search(as,keywords);
 
 	finish_working(as);
 }
 
-static void add_file(app_state *as,gchar *filename,gchar *keywords)
+static void query_files(app_state *as,gchar *expression)
+{
+	g_print("%s\n",PROGRAM_NAME);
+	g_print("Query is: %s\n",expression);
+
+	start_working(as,FALSE);
+
+	logic_query(as,expression);
+
+	finish_working(as);
+}
+
+static void add_files(app_state *as,gchar **filenames,gchar *keywords)
 {
 
 	g_print("%s\n",PROGRAM_NAME);
-	g_print("File is: %s\n",filename);
+	if(g_strv_length(filenames) == 1) g_print("File is: %s\n",filenames[0]);
+	else g_print("Files are: %d\n",g_strv_length(filenames));
 	g_print("Tags are: %s\n",keywords);
 
 
-	start_working(as);
+	start_working(as,TRUE);
 	
-	logic_import_file(as,filename,keywords);
+	logic_import_files(as,filenames,keywords);
 
 	finish_working(as);
 
 }
+
+static void add_folder(app_state *as,gchar *dirname,gchar *keywords)
+{
+	g_print("%s\n",PROGRAM_NAME);
+	g_print("Folder is: %s\n",dirname);
+	g_print("Tags are: %s\n",keywords);
+
+	start_working(as,TRUE);
+
+	logic_import_dir(as,dirname,keywords);
+
+	finish_working(as);
+}
+
+/*
+ * The path given to --add and any other argument left on the
+ * command line. A path of - means one path per line on stdin.
+ */
+static gchar **read_filenames(gchar *first,int argc,char **argv)
+{
+	GPtrArray *result = g_ptr_array_new();
+	int i;
+
+	if(g_strcmp0(first,"-") == 0)
+	{
+		GIOChannel *input = g_io_channel_unix_new(0);
+		GError *error = NULL;
+		GIOStatus status;
+		gchar *line = NULL;
+		gsize end = 0;
+
+		/* Filenames are bytes, not UTF-8 */
+		g_io_channel_set_encoding(input,NULL,NULL);
+		while((status = g_io_channel_read_line(input,&line,NULL,&end,&error)) == G_IO_STATUS_NORMAL)
+		{
+			line[end] = '\0';
+			if(line[0] != '\0') g_ptr_array_add(result,line);
+			else g_free(line);
+		}
+		if(status == G_IO_STATUS_ERROR)
+		{
+			g_print("Could not read filenames from stdin: %s\n",error->message);
+			g_error_free(error);
+			exit(1);
+		}
+		g_io_channel_unref(input);
+	}
+	else
+		g_ptr_array_add(result,g_strdup(first));
+
+	for(i = 1;i < argc;i++)
+		g_ptr_array_add(result,g_strdup(argv[i]));
+
+	g_ptr_array_add(result,NULL);
+	return (gchar **)g_ptr_array_free(result,FALSE);
+}
 static void build_db(app_state *as)
 {
 	gboolean exists = TRUE;
@@ -227,6 +324,9 @@ static app_state *init(gboolean debug)
 	
 	result = g_new(app_state,1);
 	result -> debug_mode = debug;
+	result -> tag_counts = NULL;
+	result -> statements = NULL;
+	result -> lock_fd = -1;
 
 	/* First find the home directory of the user */
 	path = g_getenv("HOME");
@@ -239,9 +339,11 @@ static app_state *init(gboolean debug)
 	g_snprintf(result->vault_path,_POSIX_PATH_MAX,"%s/%s",path,VAULT_DIR);
 	g_snprintf(result->db_path,_POSIX_PATH_MAX,"%s/%s/%s",path,VAULT_DIR,DB_NAME);
 	g_snprintf(result->store_path,_POSIX_PATH_MAX,"%s/%s/%s",path,VAULT_DIR,STORE_NAME);
+	g_snprintf(result->index_path,_POSIX_PATH_MAX,"%s/%s/%s",path,VAULT_DIR,TAG_INDEX_NAME);
 	return result;
 }
-static void start_working(app_state *as)
+/* An import holds the import lock until it finishes */
+static void start_working(app_state *as,gboolean import)
 {
 	gboolean exists = TRUE;
 
@@ -255,10 +357,30 @@ static void start_working(app_state *as)
 	}
 	/* Open the existing database */
 	dbfs_init(as);
+	/*
+	 * A previous import may have been interrupted. The journal of
+	 * an import that is still running is left to it.
+	 */
+	if(import)
+	{
+		if(dbfs_lock(as,FALSE) == FALSE)
+		{
+			g_print("Waiting for another import to finish\n");
+			if(dbfs_lock(as,TRUE) == FALSE) exit(1);
+		}
+		logic_recover(as);
+	}
+	else if(dbfs_lock(as,FALSE))
+	{
+		logic_recover(as);
+		dbfs_unlock(as);
+	}
+	else if(as->debug_mode) g_debug("An import is running, its journal is left alone\n");
 }
 
 static void finish_working(app_state *as)
 {
 	/* Finished work */
 	dbfs_shutdown(as);
+	dbfs_unlock(as);
 }
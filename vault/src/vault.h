@@ -24,6 +24,8 @@
 #define VAULT_DIR ".vault"
 #define DB_NAME "vault.db"
 #define STORE_NAME "storage"
+#define TAG_INDEX_NAME "tags.idx"
+#define LOCK_NAME "lock"
 
 /* Size of the recent file list */
 #define MAX_RECENT 20
@@ -36,10 +38,15 @@
 typedef struct application_state
 {
 	sqlite3 *db; /* The handle for the database */
+	sqlite3_stmt **statements; /* Prepared once. Indexed by StatementId (see db.h) */
 	gchar vault_path[_POSIX_PATH_MAX]; /* Path to vault directory. Defined by VAULT_DIR */
 	gchar db_path[_POSIX_PATH_MAX]; /* Path to vault.db file. Defined by VAULT_DIR and DB_NAME*/
 	gchar store_path[_POSIX_PATH_MAX];/* Path for stored files. Defined by STORE_NAME */
+	gchar index_path[_POSIX_PATH_MAX];/* Bitmaps of the tags. Defined by TAG_INDEX_NAME */
+	GHashTable *tag_counts; /* Tag -> files. Loaded by the first import of the run */
+	int lock_fd; /* Holds the import lock (see dbfs_lock), -1 if not held */
 	gboolean debug_mode; /* Defined by command line parameters */
+	gboolean checksum_mode; /* Defined by command line parameters */
 }app_state;
 
 #endif